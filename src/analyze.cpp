@@ -0,0 +1,183 @@
+#include "analyze.hpp"
+#include "board.hpp"
+#include "protocol.hpp"
+#include "search.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hexchess {
+namespace analyze {
+
+namespace {
+
+struct Line {
+  int number = 0;
+  std::string text;
+};
+
+struct Result {
+  bool valid = false;
+  std::optional<board::Move> move;
+  std::vector<board::Move> pv;
+  int score = 0, depth = 0, time_ms = 0;
+  long long nodes = 0;
+};
+
+struct Options {
+  std::string file;
+  int nodes = 0;
+  int movetime_ms = 0;
+  int depth = 0;
+  int threads = 0;  // 0 = hardware
+};
+
+// results are printed by the main thread as soon as everything before them is done
+struct Output {
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::vector<char> done;
+};
+
+std::string trim(const std::string& s) {
+  size_t a = s.find_first_not_of(" \t\r");
+  if (a == std::string::npos) return "";
+  size_t b = s.find_last_not_of(" \t\r");
+  return s.substr(a, b - a + 1);
+}
+
+// fresh tables per position so results dont depend on which worker got it
+void analyze(const Line& line, const search::SearchLimits& limits, search::SearchTables& tables, Result& r) {
+  search::Node root;
+  if (protocol::parse_position(line.text, root.state) == 0) return;
+  r.valid = true;
+  tables.clear();
+  search::SearchInfo last;
+  search::InfoCallback on_info = [&](const search::SearchInfo& info) {
+    if (info.multipv <= 1) last = info;
+  };
+  auto t0 = std::chrono::steady_clock::now();
+  search::iterative_deepen(root, limits, tables, nullptr, on_info);
+  r.time_ms = static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count());
+  // the last completed depth: a partial one can leave a move without a score
+  r.move = last.pv.empty() ? root.best_move : std::optional<board::Move>(last.pv.front());
+  r.pv = std::move(last.pv);
+  r.score = last.score;
+  r.depth = last.depth;
+  r.nodes = last.nodes;
+}
+
+void print(const Line& line, const Result& r) {
+  if (!r.valid) {
+    std::printf("{\"line\":%d,\"error\":\"invalid position\"}\n", line.number);
+  } else if (!r.move) {
+    std::printf("{\"line\":%d,\"move\":null,\"score\":%d,\"depth\":%d,\"nodes\":%lld,\"time\":%d,\"pv\":\"\"}\n",
+        line.number, r.score, r.depth, r.nodes, r.time_ms);
+  } else {
+    std::string pv;
+    for (const board::Move& m : r.pv) pv += (pv.empty() ? "" : " ") + protocol::format_move(m);
+    std::printf("{\"line\":%d,\"move\":\"%s\",\"score\":%d,\"depth\":%d,\"nodes\":%lld,\"time\":%d,\"pv\":\"%s\"}\n",
+        line.number, protocol::format_move(*r.move).c_str(), r.score, r.depth, r.nodes, r.time_ms, pv.c_str());
+  }
+  std::fflush(stdout);
+}
+
+// tables are cleared for every position, which costs more than a small search. a node budget
+// never fills more than about one entry per node
+int tt_size(int nodes) {
+  int size = 1 << 12;
+  while (nodes > 0 && size < search::TT_SIZE && size < 2 * nodes) size <<= 1;
+  return nodes > 0 ? size : search::TT_SIZE;
+}
+
+int usage() {
+  std::fprintf(stderr, "usage: engine analyze <file> [--nodes N | --movetime MS | --depth N] [--threads N]\n");
+  return 2;
+}
+
+}  // namespace
+
+int run(int argc, char** argv) {
+  if (argc < 1 || argc % 2 != 1) return usage();
+  Options opt;
+  opt.file = argv[0];
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i], val = argv[i + 1];
+    if (arg == "--nodes") opt.nodes = std::atoi(val.c_str());
+    else if (arg == "--movetime") opt.movetime_ms = std::atoi(val.c_str());
+    else if (arg == "--depth") opt.depth = std::atoi(val.c_str());
+    else if (arg == "--threads") opt.threads = std::atoi(val.c_str());
+    else return usage();
+  }
+  if ((opt.nodes > 0) + (opt.movetime_ms > 0) + (opt.depth > 0) > 1) return usage();
+  if (opt.nodes <= 0 && opt.depth <= 0) opt.movetime_ms = std::max(opt.movetime_ms, 1000);
+
+  std::ifstream in(opt.file);
+  if (!in) {
+    std::fprintf(stderr, "could not read %s\n", opt.file.c_str());
+    return 1;
+  }
+  // kept as text, each worker parses into its own root
+  std::vector<Line> lines;
+  std::string text;
+  for (int n = 1; std::getline(in, text); ++n) {
+    text = trim(text);
+    if (text.empty() || text[0] == '#') continue;
+    lines.push_back(Line{ n, text });
+  }
+  if (lines.empty()) {
+    std::fprintf(stderr, "no positions\n");
+    return 1;
+  }
+
+  search::SearchLimits limits;
+  limits.max_nodes = opt.nodes;
+  limits.movetime_ms = opt.movetime_ms;
+  limits.max_depth = opt.depth;
+  limits.record_plies = 0;
+  limits.info_interval_ms = 0;
+  int threads = opt.threads > 0 ? opt.threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  threads = std::min(threads, static_cast<int>(lines.size()));
+
+  // idle workers take the next unclaimed position, so slow ones never hold up the rest
+  std::vector<Result> results(lines.size());
+  Output out;
+  out.done.assign(lines.size(), 0);
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) {
+    pool.emplace_back([&] {
+      auto tables = std::make_unique<search::SearchTables>(tt_size(opt.nodes));
+      for (size_t i; (i = next.fetch_add(1)) < lines.size();) {
+        analyze(lines[i], limits, *tables, results[i]);
+        std::lock_guard<std::mutex> lock(out.mutex);
+        out.done[i] = 1;
+        out.ready.notify_one();
+      }
+    });
+  }
+  for (size_t i = 0; i < lines.size(); ++i) {
+    {
+      std::unique_lock<std::mutex> lock(out.mutex);
+      out.ready.wait(lock, [&] { return out.done[i] != 0; });
+    }
+    print(lines[i], results[i]);
+    results[i] = Result{};  // pv memory back
+  }
+  for (auto& th : pool) th.join();
+  return 0;
+}
+
+}  // namespace analyze
+}  // namespace hexchess
@@ -0,0 +1,15 @@
+#pragma once
+
+namespace hexchess {
+namespace analyze {
+
+// batch analysis, one position per line (protocol::parse_position, anything after it ignored):
+// engine analyze <file> [--nodes N | --movetime MS | --depth N] [--threads N]
+// one JSON object per position on stdout, in input order:
+//   {"line":3,"move":"a3b4","score":41,"depth":9,"nodes":5012,"time":38,"pv":"a3b4 g7g6"}
+// score is white POV as everywhere else. invalid lines get {"line":3,"error":"invalid position"}.
+// every position gets fresh search tables. args without "engine analyze". returns the exit code
+int run(int argc, char** argv);
+
+}  // namespace analyze
+}  // namespace hexchess
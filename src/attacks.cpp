@@ -0,0 +1,229 @@
+#include "attacks.hpp"
+#include <algorithm>
+
+namespace hexchess {
+namespace attacks {
+
+using namespace board;
+
+// (col_delta, logical_row_delta)
+struct Dir { int dc, dr; };
+
+// 6 horizontal (rook) then 6 diagonal (bishop). king uses all 12
+static const Dir RAYS[NUM_RAYS] = {
+  { 0, 1 }, { 0, -1 }, { -1, 0 }, { 1, 0 }, { 1, 1 }, { -1, -1 },
+  { -2, -1 }, { 2, 1 }, { 1, 2 }, { -1, 1 }, { 1, -1 }, { -1, -2 }
+};
+static const Dir KNIGHT[MAX_JUMPS] = {
+  { 1, 3 }, { 2, 3 }, { 3, 1 }, { 3, 2 }, { 2, -1 }, { 1, -2 },
+  { -1, -3 }, { -2, -3 }, { -3, -1 }, { -3, -2 }, { -2, 1 }, { -1, 2 }
+};
+static const Dir PAWN_CAP[2][2] = {
+  { { -1, 0 }, { 1, 1 } },    // white
+  { { -1, -1 }, { 1, 0 } }    // black
+};
+
+// cell one step from (col, storage_row), -1 if off the board
+static int step(Variant v, int col, int storage_row, const Dir& d) {
+  int nc = col + d.dc;
+  int nr = get_storage_row(nc, get_logical_row(col, storage_row) + d.dr);
+  return State::on_board(v, nc, nr) ? cell(nc, nr) : -1;
+}
+
+static Tables build_tables(Variant v) {
+  Tables t;
+  for (auto& rays : t.rays) for (auto& ray : rays) ray.fill(-1);
+  for (auto& list : t.knight) list.fill(-1);
+  for (auto& list : t.king) list.fill(-1);
+  for (auto& side : t.pawn_captures) for (auto& list : side) list.fill(-1);
+  for (int c = 0; c < NUM_COLS; ++c) {
+    for (int r = 0; r < max_row(v, c); ++r) {
+      int from = cell(c, r);
+      for (int d = 0; d < NUM_RAYS; ++d) {
+        int n = 0;
+        for (int at = step(v, c, r, RAYS[d]); at >= 0; at = step(v, cell_col(at), cell_row(at), RAYS[d]))
+          t.rays[from][d][n++] = static_cast<int8_t>(at);
+      }
+      int nk = 0, nn = 0;
+      for (int d = 0; d < MAX_JUMPS; ++d) {
+        int k = step(v, c, r, RAYS[d]);
+        if (k >= 0) t.king[from][nk++] = static_cast<int8_t>(k);
+        int n = step(v, c, r, KNIGHT[d]);
+        if (n >= 0) t.knight[from][nn++] = static_cast<int8_t>(n);
+      }
+      for (int s = 0; s < 2; ++s) {
+        int np = 0;
+        for (const Dir& d : PAWN_CAP[s]) {
+          int p = step(v, c, r, d);
+          if (p >= 0) t.pawn_captures[s][from][np++] = static_cast<int8_t>(p);
+        }
+      }
+    }
+  }
+  return t;
+}
+
+const Tables& tables(Variant variant) {
+  static const std::array<Tables, 3> all = {
+    build_tables(Variant::Glinski), build_tables(Variant::McCooey), build_tables(Variant::Hexofen)
+  };
+  return all[static_cast<size_t>(variant)];
+}
+
+static bool occupied(const State& state, int c) {
+  return state.cells[static_cast<size_t>(cell_col(c))][static_cast<size_t>(cell_row(c))].has_value();
+}
+
+static uint8_t value_rank(char type) {
+  switch (type) {
+    case 'P': return 0; case 'N': return 1; case 'B': return 2;
+    case 'R': return 3; case 'Q': return 4; case 'K': return 5;
+    default: return 0;
+  }
+}
+
+const SideAttacks& AttackMap::side(bool white) const {
+  size_t s = white ? 0 : 1;
+  SideAttacks& out = sides[s];
+  if (built[s]) return out;
+  built[s] = true;
+  const Tables& t = tables(state.variant);
+  out.count.fill(0);
+  out.least.fill(NO_ATTACKER);
+  out.num_pieces = 0;
+  out.king_cell = -1;
+  for (int c = 0; c < NUM_COLS; ++c) {
+    int maxr = max_row(state.variant, c);
+    for (int r = 0; r < maxr; ++r) {
+      const Square& sq = state.cells[static_cast<size_t>(c)][static_cast<size_t>(r)];
+      if (!sq || sq->white != white || out.num_pieces == MAX_PIECES) continue;
+      int from = cell(c, r);
+      PieceAttacks& pa = out.pieces[static_cast<size_t>(out.num_pieces++)];
+      pa.from = static_cast<int8_t>(from);
+      pa.type = sq->type;
+      pa.num_targets = 0;
+      uint8_t rank = value_rank(sq->type);
+      auto add = [&](int8_t to) {
+        pa.targets[pa.num_targets++] = to;
+        out.count[static_cast<size_t>(to)]++;
+        out.least[static_cast<size_t>(to)] = std::min(out.least[static_cast<size_t>(to)], rank);
+      };
+      auto add_list = [&](const int8_t* list) {
+        for (; *list >= 0; ++list) add(*list);
+      };
+      auto add_rays = [&](int first, int last) {
+        for (int d = first; d < last; ++d) {
+          for (const int8_t* to = t.rays[from][d].data(); *to >= 0; ++to) {
+            add(*to);
+            if (occupied(state, *to)) break;
+          }
+        }
+      };
+      switch (sq->type) {
+        case 'P': add_list(t.pawn_captures[s][from].data()); break;
+        case 'N': add_list(t.knight[from].data()); break;
+        case 'K':
+          add_list(t.king[from].data());
+          out.king_cell = from;
+          break;
+        case 'R': add_rays(0, FIRST_DIAG_RAY); break;
+        case 'B': add_rays(FIRST_DIAG_RAY, NUM_RAYS); break;
+        case 'Q': add_rays(0, NUM_RAYS); break;
+        default: break;
+      }
+    }
+  }
+  return out;
+}
+
+int see_value(char type) {
+  switch (type) {
+    case 'P': return 100;
+    case 'N': return 300;
+    case 'B': return 310;
+    case 'R': return 480;
+    case 'Q': return 900;
+    case 'K': return 20000;
+    default: return 0;
+  }
+}
+
+// cheapest piece of side white attacking to, given what is still on the board. -1 if none
+static int least_attacker(const State& state, const Tables& t, const std::array<bool, CELLS>& occ,
+    int to, bool white, int& value) {
+  int best = -1;
+  value = 0;
+  auto consider = [&](int c, const char* types) {
+    const Square& sq = state.cells[static_cast<size_t>(cell_col(c))][static_cast<size_t>(cell_row(c))];
+    if (!sq || sq->white != white) return;
+    for (; *types; ++types) {
+      if (sq->type != *types) continue;
+      int v = see_value(sq->type);
+      if (best < 0 || v < value) {
+        best = c;
+        value = v;
+      }
+      return;
+    }
+  };
+  // a pawn of side white attacks to from where the other color's pawn captures would land
+  for (const int8_t* p = t.pawn_captures[white ? 1 : 0][to].data(); *p >= 0; ++p)
+    if (occ[static_cast<size_t>(*p)]) consider(*p, "P");
+  for (const int8_t* p = t.knight[to].data(); *p >= 0; ++p)
+    if (occ[static_cast<size_t>(*p)]) consider(*p, "N");
+  for (const int8_t* p = t.king[to].data(); *p >= 0; ++p)
+    if (occ[static_cast<size_t>(*p)]) consider(*p, "K");
+  for (int d = 0; d < NUM_RAYS; ++d) {
+    for (const int8_t* p = t.rays[to][d].data(); *p >= 0; ++p) {
+      if (!occ[static_cast<size_t>(*p)]) continue;
+      consider(*p, d < FIRST_DIAG_RAY ? "RQ" : "BQ");
+      break;
+    }
+  }
+  return best;
+}
+
+int see(const AttackMap& map, const Move& move) {
+  const State& state = map.state;
+  auto mover = state.at(move.from_col, move.from_row);
+  if (!mover) return 0;
+  auto target = state.at(move.to_col, move.to_row);
+  int gain[48];
+  gain[0] = move.en_passant ? see_value('P') : (target ? see_value(target->type) : 0);
+  int to = cell(move.to_col, move.to_row);
+  // nothing recaptures: no need to play it out
+  if (!map.side(!mover->white).attacks(to)) return gain[0];
+
+  const Tables& t = tables(state.variant);
+  std::array<bool, CELLS> occ{};
+  for (int c = 0; c < NUM_COLS; ++c)
+    for (int r = 0; r < max_row(state.variant, c); ++r)
+      occ[static_cast<size_t>(cell(c, r))] = occupied(state, cell(c, r));
+  occ[static_cast<size_t>(cell(move.from_col, move.from_row))] = false;
+
+  // gain[d] = material for whoever makes capture d if the exchange stops there
+  int on_square = see_value(mover->type);
+  bool white = !mover->white;
+  int d = 0;
+  while (d + 1 < 48) {
+    int value = 0;
+    int from = least_attacker(state, t, occ, to, white, value);
+    if (from < 0) break;
+    ++d;
+    gain[d] = on_square - gain[d - 1];
+    on_square = value;
+    occ[static_cast<size_t>(from)] = false;
+    white = !white;
+  }
+  // each side may stop instead of capturing
+  for (; d > 0; --d) gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+  return gain[0];
+}
+
+bool king_attacked(const AttackMap& map, bool white) {
+  int k = map.side(white).king_cell;
+  return k >= 0 && map.side(!white).attacks(k);
+}
+
+}  // namespace attacks
+}  // namespace hexchess
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "board.hpp"
+#include <array>
+#include <cstdint>
+
+namespace hexchess {
+namespace attacks {
+
+// cell = col * 11 + storage row (121 slots, 91 on the board)
+constexpr int CELLS = board::NUM_COLS * 11;
+inline int cell(int col, int storage_row) { return col * 11 + storage_row; }
+inline int cell_col(int cell) { return cell / 11; }
+inline int cell_row(int cell) { return cell % 11; }
+
+// 6 straight (rook) then 6 diagonal (bishop)
+constexpr int NUM_RAYS = 12;
+constexpr int FIRST_DIAG_RAY = 6;
+constexpr int MAX_RAY = 10;
+constexpr int MAX_JUMPS = 12;
+
+// precomputed geometry for a variant. lists are nearest first, -1 terminated
+struct Tables {
+  std::array<std::array<std::array<int8_t, MAX_RAY + 1>, NUM_RAYS>, CELLS> rays;
+  std::array<std::array<int8_t, MAX_JUMPS + 1>, CELLS> knight;
+  std::array<std::array<int8_t, MAX_JUMPS + 1>, CELLS> king;
+  std::array<std::array<std::array<int8_t, 3>, CELLS>, 2> pawn_captures;  // [white ? 0 : 1]
+};
+const Tables& tables(board::Variant variant);
+
+// one piece and the cells it attacks, in move generation order (pawns: capture cells).
+// no initializers: filled when the side is built
+constexpr int MAX_TARGETS = 64;
+struct PieceAttacks {
+  int8_t from;
+  char type;
+  uint8_t num_targets;
+  std::array<int8_t, MAX_TARGETS> targets;
+};
+
+// everything one side attacks
+constexpr int MAX_PIECES = 32;
+constexpr uint8_t NO_ATTACKER = 0xFF;
+struct SideAttacks {
+  std::array<uint8_t, CELLS> count;  // attackers per cell
+  std::array<uint8_t, CELLS> least;  // cheapest attacker's value rank (P N B R Q K), NO_ATTACKER if none
+  std::array<PieceAttacks, MAX_PIECES> pieces;
+  int num_pieces = 0;
+  int king_cell = -1;
+  bool attacks(int c) const { return count[static_cast<size_t>(c)] != 0; }
+};
+
+// per-node attack maps, each side built on first use. refers to the state, which must not
+// change while the map is in use
+struct AttackMap {
+  explicit AttackMap(const board::State& s) : state(s) {}
+  const board::State& state;
+  const SideAttacks& side(bool white) const;
+  mutable std::array<SideAttacks, 2> sides;
+  mutable std::array<bool, 2> built{};
+};
+
+// static exchange evaluation of a capture on its target, centipawns for the mover
+int see_value(char type);
+int see(const AttackMap& map, const board::Move& move);
+
+// the white (or black) king stands on a cell the other side attacks
+bool king_attacked(const AttackMap& map, bool white);
+
+}  // namespace attacks
+}  // namespace hexchess
@@ -1,7 +1,9 @@
 #include "board.hpp"
+#include "eval.hpp"
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
 #include <stdexcept>
 
 namespace hexchess {
@@ -16,14 +18,22 @@ static constexpr int ZOBRIST_EP_KEYS = ZOBRIST_COLS * ZOBRIST_ROWS;
 static constexpr int ZOBRIST_SIZE = ZOBRIST_PIECE_KEYS + 1 + ZOBRIST_EP_KEYS;
 
 static uint64_t g_zobrist_keys[ZOBRIST_SIZE];
-static bool g_zobrist_init = false;
+static std::once_flag g_zobrist_once;
 
+// splitmix64 from a fixed seed: the same keys on every platform, since opening books store them
+static constexpr uint64_t ZOBRIST_SEED = 0x48657843686573ULL;
+
+// threads may build their first State at the same time
 static void init_zobrist() {
-  if (g_zobrist_init) return;
-  for (int i = 0; i < ZOBRIST_SIZE; ++i) {
-    g_zobrist_keys[i] = (static_cast<uint64_t>(rand()) << 32) | rand();
-  }
-  g_zobrist_init = true;
+  std::call_once(g_zobrist_once, [] {
+    uint64_t x = ZOBRIST_SEED;
+    for (int i = 0; i < ZOBRIST_SIZE; ++i) {
+      uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      g_zobrist_keys[i] = z ^ (z >> 31);
+    }
+  });
 }
 
 static int piece_to_index(char type, bool white) {
@@ -36,33 +46,80 @@ static int piece_to_index(char type, bool white) {
   return t * 2 + (white ? 0 : 1);
 }
 
-uint64_t State::hash() const {
+static uint64_t piece_key(int col, int storage_row, const Piece& p) {
+  return g_zobrist_keys[(col * ZOBRIST_ROWS + storage_row) * ZOBRIST_PIECES + piece_to_index(p.type, p.white)];
+}
+
+// ep square left by a double step, 0 if none
+static uint64_t ep_key(const std::optional<Move>& prev_move, bool white_to_play) {
+  if (!prev_move || std::abs(prev_move->to_row - prev_move->from_row) != 2) return 0;
+  bool moved_white = !white_to_play;
+  int ep_row = moved_white ? prev_move->to_row - 1 : prev_move->to_row + 1;
+  int ep_idx = ZOBRIST_PIECE_KEYS + 1 + prev_move->to_col * ZOBRIST_ROWS + ep_row;
+  return ep_idx < ZOBRIST_SIZE ? g_zobrist_keys[ep_idx] : 0;
+}
+
+uint64_t State::compute_hash() const {
   init_zobrist();
   uint64_t h = 0;
   for (int c = 0; c < NUM_COLS; ++c) {
     int maxr = static_cast<int>(cells[static_cast<size_t>(c)].size());
     for (int r = 0; r < maxr && r < ZOBRIST_ROWS; ++r) {
       auto sq = at(c, r);
-      if (sq) {
-        int idx = (c * ZOBRIST_ROWS + r) * ZOBRIST_PIECES + piece_to_index(sq->type, sq->white);
-        h ^= g_zobrist_keys[idx];
-      }
+      if (sq) h ^= piece_key(c, r, *sq);
     }
   }
   if (white_to_play) h ^= g_zobrist_keys[ZOBRIST_PIECE_KEYS];
-  if (prev_move && std::abs(prev_move->to_row - prev_move->from_row) == 2) {
-    bool moved_white = !white_to_play;
-    int ep_row = moved_white ? prev_move->to_row - 1 : prev_move->to_row + 1;
-    int ep_idx = ZOBRIST_PIECE_KEYS + 1 + prev_move->to_col * ZOBRIST_ROWS + ep_row;
-    if (ep_idx < ZOBRIST_SIZE) h ^= g_zobrist_keys[ep_idx];
+  h ^= ep_key(prev_move, white_to_play);
+  return h;
+}
+
+void State::compute_psq(int& mg, int& eg, int& phase) const {
+  mg = eg = phase = 0;
+  for (int c = 0; c < NUM_COLS; ++c) {
+    int maxr = static_cast<int>(cells[static_cast<size_t>(c)].size());
+    for (int r = 0; r < maxr; ++r) {
+      auto sq = at(c, r);
+      if (!sq) continue;
+      eval::Score v = eval::psq(variant, *sq, c, r);
+      mg += v.mg;
+      eg += v.eg;
+      phase += eval::phase_weight(sq->type);
+    }
+  }
+}
+
+// piece on / off a square: keys and psq sums
+void State::add_piece(int col, int storage_row, const Piece& p, int sign) {
+  uint64_t k = piece_key(col, storage_row, p);
+  key ^= k;
+  if (p.type == 'P') pawn_key ^= k;
+  eval::Score v = eval::psq(variant, p, col, storage_row);
+  psq_mg += sign * v.mg;
+  psq_eg += sign * v.eg;
+  phase += sign * eval::phase_weight(p.type);
+  nnue::update(*this, col, storage_row, p, sign);
+}
+
+uint64_t State::compute_pawn_key() const {
+  init_zobrist();
+  uint64_t h = 0;
+  for (int c = 0; c < NUM_COLS; ++c) {
+    int maxr = static_cast<int>(cells[static_cast<size_t>(c)].size());
+    for (int r = 0; r < maxr && r < ZOBRIST_ROWS; ++r) {
+      auto sq = at(c, r);
+      if (sq && sq->type == 'P') h ^= piece_key(c, r, *sq);
+    }
   }
   return h;
 }
 
 State::State() {
+  init_zobrist();
   cells.resize(NUM_COLS);
   for (int c = 0; c < NUM_COLS; ++c)
     cells[c].resize(static_cast<size_t>(max_row_glinski(c)));
+  refresh();
 }
 
 void State::set_glinski() {
@@ -99,6 +156,9 @@ void State::set_glinski() {
   }
   white_to_play = true;
   prev_move = std::nullopt;
+  halfmove_clock = 0;
+  fullmove = 1;
+  refresh();
 }
 
 void State::set_mccooey() {
@@ -134,6 +194,9 @@ void State::set_mccooey() {
   }
   white_to_play = true;
   prev_move = std::nullopt;
+  halfmove_clock = 0;
+  fullmove = 1;
+  refresh();
 }
 
 void State::set_hexofen() {
@@ -169,6 +232,9 @@ void State::set_hexofen() {
   }
   white_to_play = true;
   prev_move = std::nullopt;
+  halfmove_clock = 0;
+  fullmove = 1;
+  refresh();
 }
 
 bool State::on_board(int col, int storage_row) const {
@@ -189,11 +255,19 @@ std::optional<Piece> State::at(int col, int storage_row) const {
 State::UndoInfo State::make_move(const Move& move) {
   UndoInfo ui;
   ui.prev_move = prev_move;
+  ui.key = key;
+  ui.pawn_key = pawn_key;
+  ui.halfmove_clock = halfmove_clock;
+  ui.psq_mg = psq_mg;
+  ui.psq_eg = psq_eg;
+  ui.phase = phase;
+  key ^= ep_key(prev_move, white_to_play);
 
   Square& from_sq = cells[static_cast<size_t>(move.from_col)][static_cast<size_t>(move.from_row)];
   Square& to_sq = cells[static_cast<size_t>(move.to_col)][static_cast<size_t>(move.to_row)];
   Piece p = *from_sq;
   from_sq = std::nullopt;
+  add_piece(move.from_col, move.from_row, p, -1);
 
   // detect ep when protocol doesnt send ep flag
   bool is_ep = move.en_passant;
@@ -214,42 +288,64 @@ State::UndoInfo State::make_move(const Move& move) {
       ui.captured = cells[static_cast<size_t>(ep_col)][static_cast<size_t>(ep_row)];
       ui.was_ep = true;
       cells[static_cast<size_t>(ep_col)][static_cast<size_t>(ep_row)] = std::nullopt;
+      if (ui.captured) add_piece(ep_col, ep_row, *ui.captured, -1);
     }
   } else if (to_sq) {
     ui.captured = *to_sq;
+    add_piece(move.to_col, move.to_row, *to_sq, -1);
   }
 
+  halfmove_clock = (p.type == 'P' || ui.captured) ? 0 : halfmove_clock + 1;
+
   if (move.promotion)
     p.type = 'Q';
   to_sq = p;
+  add_piece(move.to_col, move.to_row, p, 1);
 
   if (p.type == 'P' && std::abs(move.to_row - move.from_row) == 2)
     prev_move = move;
   else
     prev_move = std::nullopt;
 
+  if (!white_to_play) ++fullmove;
   white_to_play = !white_to_play;
+  key ^= g_zobrist_keys[ZOBRIST_PIECE_KEYS];
+  key ^= ep_key(prev_move, white_to_play);
   return ui;
 }
 
 void State::undo_move(const Move& move, const UndoInfo& undo) {
   white_to_play = !white_to_play;
+  if (!white_to_play) --fullmove;
   prev_move = undo.prev_move;
+  key = undo.key;
+  pawn_key = undo.pawn_key;
+  halfmove_clock = undo.halfmove_clock;
+  psq_mg = undo.psq_mg;
+  psq_eg = undo.psq_eg;
+  phase = undo.phase;
 
   Square& from_sq = cells[static_cast<size_t>(move.from_col)][static_cast<size_t>(move.from_row)];
   Square& to_sq = cells[static_cast<size_t>(move.to_col)][static_cast<size_t>(move.to_row)];
 
+  // make_move in reverse, so the nnue accumulator sees the same sequence backwards
+  bool track = nnue::active(variant);
   Piece p = *to_sq;
-  if (move.promotion) p.type = 'P';
-  from_sq = p;
   to_sq = std::nullopt;
+  if (track) nnue::update(*this, move.to_col, move.to_row, p, -1);
+  if (move.promotion) p.type = 'P';
 
   // restore ep capture
   int ep_row = p.white ? move.to_row - 1 : move.to_row + 1;
-  if (undo.was_ep && undo.captured && on_board(move.to_col, ep_row))
+  if (undo.was_ep && undo.captured && on_board(move.to_col, ep_row)) {
     cells[static_cast<size_t>(move.to_col)][static_cast<size_t>(ep_row)] = *undo.captured;
-  else if (undo.captured)
+    if (track) nnue::update(*this, move.to_col, ep_row, *undo.captured, 1);
+  } else if (undo.captured) {
     to_sq = *undo.captured;
+    if (track) nnue::update(*this, move.to_col, move.to_row, *undo.captured, 1);
+  }
+  from_sq = p;
+  if (track) nnue::update(*this, move.from_col, move.from_row, p, 1);
 }
 
 std::string square_notation(int col, int row) {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "nnue.hpp"
 #include <cstdint>
 #include <optional>
 #include <string>
@@ -61,6 +62,14 @@ struct State {
   bool white_to_play = true;
   std::optional<Move> prev_move;
   Variant variant = Variant::Glinski;
+  uint64_t key = 0;  // zobrist, kept up to date by make_move/undo_move
+  uint64_t pawn_key = 0;  // zobrist of the pawns only
+  int halfmove_clock = 0;  // plies since last pawn move or capture
+  int fullmove = 1;  // +1 after each black move
+  // material + piece-square sums (eval::psq), white POV. incremental like key
+  int psq_mg = 0, psq_eg = 0;
+  int phase = 0;  // sum of eval::phase_weight
+  nnue::Accumulator nnue;  // only maintained while a net is loaded for the variant
 
   State();
   // Glinski/McCooey/Hexofen start pos
@@ -74,14 +83,33 @@ struct State {
 
   std::optional<Piece> at(int col, int storage_row) const;
 
-  // zobrist for TT
-  uint64_t hash() const;
+  // zobrist for TT (incremental key)
+  uint64_t hash() const { return key; }
+  // full recompute. call refresh() after editing cells directly
+  uint64_t compute_hash() const;
+  uint64_t compute_pawn_key() const;
+  void compute_psq(int& mg, int& eg, int& phase) const;
+  void refresh() {
+    key = compute_hash();
+    pawn_key = compute_pawn_key();
+    compute_psq(psq_mg, psq_eg, phase);
+    nnue::refresh(*this);
+  }
+
+  // xor the piece into the keys, add (sign 1) or remove (-1) its psq score and phase, update the
+  // nnue accumulator. cells untouched, except an own king going on must already be there
+  void add_piece(int col, int storage_row, const Piece& p, int sign);
 
   // make move (assumes legal). returns undo info
   struct UndoInfo {
     std::optional<Piece> captured;
     bool was_ep = false;
     std::optional<Move> prev_move;
+    uint64_t key = 0;
+    uint64_t pawn_key = 0;
+    int halfmove_clock = 0;
+    int psq_mg = 0, psq_eg = 0;
+    int phase = 0;
   };
   UndoInfo make_move(const Move& move);
 
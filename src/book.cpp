@@ -0,0 +1,278 @@
+#include "book.hpp"
+#include "attacks.hpp"
+#include "moves.hpp"
+#include "protocol.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "book entries are mapped as little-endian"
+#endif
+
+namespace hexchess {
+namespace book {
+
+// 2: zobrist keys from a fixed seed, the same on every platform
+static constexpr uint32_t BOOK_VERSION = 2;
+static constexpr size_t HEADER_BYTES = 8;
+// merge duplicates once this many raw entries pile up while building
+static constexpr size_t MERGE_ENTRIES = 1 << 22;
+
+// the loaded book: mapped where possible, else read into g_buffer
+static const Entry* g_entries = nullptr;
+static size_t g_count = 0;
+static std::vector<Entry> g_buffer;
+static std::mutex g_rng_mutex;
+static std::mt19937_64 g_rng{ std::random_device{}() };
+
+static bool same_squares(const board::Move& a, const board::Move& b) {
+  return a.from_col == b.from_col && a.from_row == b.from_row && a.to_col == b.to_col && a.to_row == b.to_row;
+}
+
+bool load(const std::string& path) {
+  const unsigned char* data = nullptr;
+  size_t size = 0;
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(HEADER_BYTES)) {
+    close(fd);
+    return false;
+  }
+  size = static_cast<size_t>(st.st_size);
+  void* base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return false;
+  data = static_cast<const unsigned char*>(base);
+#else
+  std::ifstream f(path, std::ios::binary);
+  if (!f) return false;
+  std::string buffer((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+  data = reinterpret_cast<const unsigned char*>(buffer.data());
+  size = buffer.size();
+#endif
+  uint32_t version = 0;
+  if (size >= HEADER_BYTES) std::memcpy(&version, data + 4, 4);
+  bool ok = size >= HEADER_BYTES && std::memcmp(data, "HXBK", 4) == 0 && version == BOOK_VERSION &&
+      (size - HEADER_BYTES) % sizeof(Entry) == 0;
+#ifndef _WIN32
+  // stays mapped for the life of the process
+  if (!ok) {
+    munmap(base, size);
+    return false;
+  }
+  g_entries = reinterpret_cast<const Entry*>(data + HEADER_BYTES);
+  g_count = (size - HEADER_BYTES) / sizeof(Entry);
+#else
+  if (!ok) return false;
+  g_buffer.resize((size - HEADER_BYTES) / sizeof(Entry));
+  if (!g_buffer.empty()) std::memcpy(g_buffer.data(), data + HEADER_BYTES, size - HEADER_BYTES);
+  g_entries = g_buffer.data();
+  g_count = g_buffer.size();
+#endif
+  return true;
+}
+
+std::optional<board::Move> probe(const board::State& state) {
+  if (!g_entries) return std::nullopt;
+  const Entry* end = g_entries + g_count;
+  const Entry* it = std::lower_bound(g_entries, end, state.key, [](const Entry& e, uint64_t key) { return e.key < key; });
+  // playable entries of this position; a key collision leaves moves that arent legal here
+  std::vector<board::Move> generated = moves::generate(state);
+  std::vector<std::pair<board::Move, uint32_t>> candidates;
+  uint64_t total = 0;
+  for (; it != end && it->key == state.key; ++it) {
+    if (it->variant != static_cast<uint8_t>(state.variant) || it->weight == 0) continue;
+    board::Move m{ attacks::cell_col(it->from), attacks::cell_row(it->from), attacks::cell_col(it->to),
+        attacks::cell_row(it->to), false, false, false };
+    auto g = std::find_if(generated.begin(), generated.end(), [&](const board::Move& x) { return same_squares(x, m); });
+    if (g == generated.end()) continue;
+    candidates.emplace_back(*g, it->weight);
+    total += it->weight;
+  }
+  if (candidates.empty()) return std::nullopt;
+  uint64_t pick;
+  {
+    std::lock_guard<std::mutex> lock(g_rng_mutex);
+    pick = g_rng() % total;
+  }
+  for (const auto& c : candidates) {
+    if (pick < c.second) return c.first;
+    pick -= c.second;
+  }
+  return candidates.back().first;
+}
+
+namespace {
+
+struct Options {
+  std::vector<std::string> from;
+  std::string out;
+  int plies = 20;
+  int min_games = 2;
+};
+
+bool same_entry(const Entry& a, const Entry& b) {
+  return a.key == b.key && a.variant == b.variant && a.from == b.from && a.to == b.to;
+}
+
+// sorts and sums up duplicates in place
+void merge(std::vector<Entry>& entries) {
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    if (a.key != b.key) return a.key < b.key;
+    if (a.variant != b.variant) return a.variant < b.variant;
+    return a.from != b.from ? a.from < b.from : a.to < b.to;
+  });
+  size_t n = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (n > 0 && same_entry(entries[n - 1], entries[i])) {
+      Entry& e = entries[n - 1];
+      e.wins += entries[i].wins;
+      e.draws += entries[i].draws;
+      e.losses += entries[i].losses;
+      e.ply = std::min(e.ply, entries[i].ply);
+    } else {
+      entries[n++] = entries[i];
+    }
+  }
+  entries.resize(n);
+}
+
+// the game's first plies as entries. false if the line is not a game
+bool add_game(const std::string& line, int plies, std::vector<Entry>& out) {
+  std::string tok;
+  board::State state;
+  // a one-line position starts with the variant name too, so it goes first
+  size_t used = protocol::parse_position(line, state);
+  std::istringstream iss(line.substr(used));
+  if (used == 0) {
+    if (!(iss >> tok)) return false;
+    if (tok == "glinski") state.set_glinski();
+    else if (tok == "mccooey") state.set_mccooey();
+    else if (tok == "hexofen") state.set_hexofen();
+    else return false;
+  }
+  std::vector<std::string> tokens;
+  while (iss >> tok) tokens.push_back(tok);
+  if (tokens.empty()) return false;
+  // white POV
+  int result;
+  if (tokens.back() == "1-0") result = 1;
+  else if (tokens.back() == "0-1") result = -1;
+  else if (tokens.back() == "1/2-1/2") result = 0;
+  else return false;
+  tokens.pop_back();
+  if (!tokens.empty() && tokens.front() != "moves") return false;
+  size_t first = out.size();
+  for (size_t i = 1; i < tokens.size() && static_cast<int>(i) <= plies; ++i) {
+    auto parsed = protocol::parse_move(tokens[i]);
+    std::vector<board::Move> generated = moves::generate(state);
+    auto it = std::find_if(generated.begin(), generated.end(), [&](const board::Move& m) { return parsed && same_squares(m, *parsed); });
+    if (it == generated.end()) {
+      out.resize(first);
+      return false;
+    }
+    int mover = state.white_to_play ? result : -result;
+    Entry e{};
+    e.key = state.key;
+    e.variant = static_cast<uint8_t>(state.variant);
+    e.from = static_cast<uint8_t>(attacks::cell(it->from_col, it->from_row));
+    e.to = static_cast<uint8_t>(attacks::cell(it->to_col, it->to_row));
+    e.wins = mover > 0;
+    e.draws = mover == 0;
+    e.losses = mover < 0;
+    e.ply = static_cast<uint32_t>(i - 1);
+    out.push_back(e);
+    board::State::UndoInfo ui = state.make_move(*it);
+    if (ui.captured && ui.captured->type == 'K') break;
+  }
+  return true;
+}
+
+int usage() {
+  std::fprintf(stderr, "usage: engine book --from <games> [--from <games> ...] --out <file> [--plies N] [--min-games N]\n");
+  return 2;
+}
+
+}  // namespace
+
+int run(int argc, char** argv) {
+  Options opt;
+  for (int i = 0; i + 1 < argc; i += 2) {
+    std::string arg = argv[i], val = argv[i + 1];
+    if (arg == "--from") opt.from.push_back(val);
+    else if (arg == "--out") opt.out = val;
+    else if (arg == "--plies") opt.plies = std::atoi(val.c_str());
+    else if (arg == "--min-games") opt.min_games = std::atoi(val.c_str());
+    else return usage();
+  }
+  if (argc % 2 != 0 || opt.from.empty() || opt.out.empty() || opt.plies <= 0) return usage();
+
+  std::vector<Entry> entries;
+  long long games = 0, skipped = 0;
+  for (const std::string& path : opt.from) {
+    std::ifstream in(path);
+    if (!in) {
+      std::fprintf(stderr, "could not read %s\n", path.c_str());
+      return 1;
+    }
+    std::string line;
+    for (int n = 1; std::getline(in, line); ++n) {
+      if (line.find_first_not_of(" \t\r") == std::string::npos || line[0] == '#') continue;
+      if (!add_game(line, opt.plies, entries)) {
+        if (skipped++ < 10) std::fprintf(stderr, "%s:%d: not a game\n", path.c_str(), n);
+        continue;
+      }
+      ++games;
+      if (entries.size() >= MERGE_ENTRIES) merge(entries);
+    }
+  }
+  merge(entries);
+
+  // rare moves say little about the move; drop them, then weigh the rest by their score
+  entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const Entry& e) {
+    return static_cast<int>(e.wins + e.draws + e.losses) < opt.min_games;
+  }), entries.end());
+  size_t positions = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    Entry& e = entries[i];
+    e.weight = 2 * e.wins + e.draws;
+    positions += i == 0 || entries[i - 1].key != e.key || entries[i - 1].variant != e.variant;
+  }
+  std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    if (a.key != b.key) return a.key < b.key;
+    if (a.variant != b.variant) return a.variant < b.variant;
+    return a.weight > b.weight;
+  });
+
+  std::ofstream f(opt.out, std::ios::binary | std::ios::trunc);
+  uint32_t version = BOOK_VERSION;
+  f.write("HXBK", 4);
+  f.write(reinterpret_cast<const char*>(&version), 4);
+  f.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(Entry)));
+  if (!f) {
+    std::fprintf(stderr, "could not write %s\n", opt.out.c_str());
+    return 1;
+  }
+  std::printf("games %lld (%lld skipped), positions %zu, moves %zu, wrote %s\n", games, skipped, positions,
+      entries.size(), opt.out.c_str());
+  return 0;
+}
+
+}  // namespace book
+}  // namespace hexchess
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "board.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace hexchess {
+namespace book {
+
+// one move from one position. file: "HXBK", u32 version 2, then the entries sorted by key,
+// variant and weight (highest first), little-endian
+struct Entry {
+  uint64_t key;  // board::State::key before the move
+  uint8_t variant;
+  uint8_t from, to;  // attacks::cell
+  uint8_t unused;
+  uint32_t weight;  // 2 per win + 1 per draw for the side that moved. 0 = never played
+  uint32_t wins, draws, losses;  // side that moved
+  uint32_t ply;  // earliest ply the position was seen at
+};
+static_assert(sizeof(Entry) == 32, "entries are read from disk as is");
+
+// maps the book read-only for probe. false if the file is missing or malformed
+bool load(const std::string& path);
+// a book move for the position, picked at random by weight, or nullopt (no book, not in it)
+std::optional<board::Move> probe(const board::State& state);
+
+// game records, one game per line: the start (variant name or protocol::parse_position), then
+// "moves" and the moves, then the result 1-0, 0-1 or 1/2-1/2. e.g.
+//   glinski moves F5F6 E7E6 1/2-1/2
+// engine book --from <games> [--from <games> ...] --out <file> [--plies N] [--min-games N]
+// args without "engine book". returns the exit code
+int run(int argc, char** argv);
+
+}  // namespace book
+}  // namespace hexchess
@@ -0,0 +1,249 @@
+#include "dataset.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "dataset records are mapped as little-endian"
+#endif
+
+namespace hexchess {
+namespace dataset {
+
+static constexpr uint32_t DATASET_VERSION = 2;
+static constexpr size_t HEADER_BYTES = 8;
+// version 1: u8 variant, u8 white to move, i16 score, i8 result, u8 0, one nibble per cell
+static constexpr size_t V1_RECORD_BYTES = 6 + (RECORD_CELLS + 1) / 2;
+static const char PIECE_CODES[] = "PRNBKQ";
+
+// cell index -> column / storage row, and the first cell of each column
+struct CellTable {
+  int col[RECORD_CELLS], row[RECORD_CELLS];
+  int first[board::NUM_COLS + 1];
+  CellTable() {
+    int i = 0;
+    for (int c = 0; c < board::NUM_COLS; ++c) {
+      first[c] = i;
+      for (int r = 0; r < board::max_row_glinski(c); ++r, ++i) {
+        col[i] = c;
+        row[i] = r;
+      }
+    }
+    first[board::NUM_COLS] = i;
+  }
+};
+static const CellTable g_cells;
+
+static uint8_t piece_code(const board::Piece& p) {
+  int t = static_cast<int>(std::find(PIECE_CODES, PIECE_CODES + 6, p.type) - PIECE_CODES);
+  return static_cast<uint8_t>(1 + t + (p.white ? 0 : 8));
+}
+
+static bool valid_code(int code) { return (code & 7) >= 1 && (code & 7) <= 6; }
+
+// the one nibble per piece layout, shared by pack and the version 1 conversion. codes is
+// zero past n so the pairing loop runs a fixed count
+static void put_pieces(Record& r, const uint8_t (&codes)[MAX_PIECES]) {
+  for (int j = 0; j < PIECE_BYTES; ++j) r.pieces[j] = static_cast<uint8_t>(codes[2 * j] | (codes[2 * j + 1] << 4));
+}
+
+std::optional<Record> pack(const board::State& state, int score, int result) {
+  Record r{};
+  uint8_t codes[MAX_PIECES] = {};
+  int n = 0;
+  for (int i = 0; i < RECORD_CELLS; ++i) {
+    const board::Square& sq = state.cells[static_cast<size_t>(g_cells.col[i])][static_cast<size_t>(g_cells.row[i])];
+    if (!sq) continue;
+    if (n == MAX_PIECES) return std::nullopt;
+    r.occupancy[i >> 3] |= static_cast<uint8_t>(1 << (i & 7));
+    codes[n++] = piece_code(*sq);
+  }
+  put_pieces(r, codes);
+  r.flags = static_cast<uint8_t>(static_cast<int>(state.variant) | (state.white_to_play ? 4 : 0));
+  r.set_result(result);
+  r.ep = NO_EP;
+  const auto& pm = state.prev_move;
+  if (pm && std::abs(pm->to_row - pm->from_row) == 2)
+    r.ep = static_cast<uint8_t>(g_cells.first[pm->to_col] + (pm->from_row + pm->to_row) / 2);
+  r.halfmove = static_cast<uint8_t>(std::min(state.halfmove_clock, 255));
+  r.score = static_cast<int16_t>(std::clamp(score, -32767, 32767));
+  r.fullmove = static_cast<uint16_t>(std::clamp(state.fullmove, 1, 65535));
+  return r;
+}
+
+int pieces(const Record& record, std::array<Placed, MAX_PIECES>& out) {
+  uint8_t codes[MAX_PIECES];
+  for (int j = 0; j < PIECE_BYTES; ++j) {
+    codes[2 * j] = record.pieces[j] & 0xF;
+    codes[2 * j + 1] = record.pieces[j] >> 4;
+  }
+  uint64_t words[2] = { 0, 0 };
+  std::memcpy(&words[0], record.occupancy, 8);
+  std::memcpy(&words[1], record.occupancy + 8, OCCUPANCY_BYTES - 8);
+  int n = 0, k = 0;
+  for (int w = 0; w < 2; ++w) {
+    for (uint64_t bits = words[w]; bits && k < MAX_PIECES; bits &= bits - 1, ++k) {
+      int i = w * 64 + __builtin_ctzll(bits);
+      int code = codes[k];
+      if (i >= RECORD_CELLS || !valid_code(code)) continue;
+      out[static_cast<size_t>(n++)] = Placed{ g_cells.col[i], g_cells.row[i], board::Piece{ PIECE_CODES[(code & 7) - 1], code < 8 } };
+    }
+  }
+  return n;
+}
+
+void unpack(const Record& record, board::State& state) {
+  state.variant = record.variant();
+  for (int c = 0; c < board::NUM_COLS; ++c) {
+    auto& column = state.cells[static_cast<size_t>(c)];
+    size_t rows = static_cast<size_t>(board::max_row(state.variant, c));
+    if (column.size() != rows) column.resize(rows);
+    std::fill(column.begin(), column.end(), std::nullopt);
+  }
+  std::array<Placed, MAX_PIECES> placed;
+  int n = pieces(record, placed);
+  for (int i = 0; i < n; ++i) {
+    const Placed& p = placed[static_cast<size_t>(i)];
+    state.cells[static_cast<size_t>(p.col)][static_cast<size_t>(p.storage_row)] = p.piece;
+  }
+  state.white_to_play = record.white_to_play();
+  // the double step that left the ep square behind
+  state.prev_move = std::nullopt;
+  if (record.ep < RECORD_CELLS) {
+    int col = g_cells.col[record.ep], row = g_cells.row[record.ep];
+    int dir = state.white_to_play ? -1 : 1;  // toward the pawn that moved
+    state.prev_move = board::Move{ col, row - dir, col, row + dir, false, false, false };
+  }
+  state.halfmove_clock = record.halfmove;
+  state.fullmove = std::max<int>(record.fullmove, 1);
+  state.refresh();
+}
+
+board::State unpack(const Record& record) {
+  board::State state;
+  unpack(record, state);
+  return state;
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static void put_u32(std::string& out, uint32_t v) {
+  for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+// version 1 had no ep square or move counters
+static bool convert_v1(const unsigned char* p, Record& r) {
+  if (p[0] > 2) return false;
+  r = Record{};
+  uint8_t codes[MAX_PIECES] = {};
+  int n = 0;
+  for (int i = 0; i < RECORD_CELLS; ++i) {
+    int code = (p[6 + i / 2] >> (4 * (i & 1))) & 0xF;
+    if (!code) continue;
+    if (n == MAX_PIECES) return false;
+    r.occupancy[i >> 3] |= static_cast<uint8_t>(1 << (i & 7));
+    codes[n++] = static_cast<uint8_t>(code);
+  }
+  put_pieces(r, codes);
+  r.flags = static_cast<uint8_t>(p[0] | (p[1] ? 4 : 0));
+  r.set_result(static_cast<int8_t>(p[4]));
+  r.ep = NO_EP;
+  r.score = static_cast<int16_t>(p[2] | (p[3] << 8));
+  r.fullmove = 1;
+  return true;
+}
+
+Mapping::~Mapping() {
+#ifndef _WIN32
+  if (mapped) munmap(mapped, mapped_bytes);
+#endif
+}
+
+bool map(const std::string& path, Mapping& out) {
+  // whole file: mapped where possible, else read
+  const unsigned char* data = nullptr;
+  size_t size = 0;
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(HEADER_BYTES)) {
+    close(fd);
+    return false;
+  }
+  size = static_cast<size_t>(st.st_size);
+  void* base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return false;
+  madvise(base, size, MADV_SEQUENTIAL);
+  out.mapped = base;
+  out.mapped_bytes = size;
+  data = static_cast<const unsigned char*>(base);
+#else
+  std::ifstream f(path, std::ios::binary);
+  if (!f) return false;
+  std::string buffer((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+  data = reinterpret_cast<const unsigned char*>(buffer.data());
+  size = buffer.size();
+#endif
+  if (size < HEADER_BYTES || std::memcmp(data, "HXTD", 4) != 0) return false;
+  uint32_t version = get_u32(data + 4);
+  size_t body = size - HEADER_BYTES;
+  if (version == DATASET_VERSION && body % RECORD_BYTES == 0) {
+    out.count = body / RECORD_BYTES;
+#ifndef _WIN32
+    out.records = reinterpret_cast<const Record*>(data + HEADER_BYTES);
+#else
+    out.converted.resize(out.count);
+    if (out.count) std::memcpy(out.converted.data(), data + HEADER_BYTES, body);
+    out.records = out.converted.data();
+#endif
+    return true;
+  }
+  if (version != 1 || body % V1_RECORD_BYTES != 0) return false;
+  out.converted.resize(body / V1_RECORD_BYTES);
+  for (size_t i = 0; i < out.converted.size(); ++i)
+    if (!convert_v1(data + HEADER_BYTES + i * V1_RECORD_BYTES, out.converted[i])) return false;
+  out.records = out.converted.data();
+  out.count = out.converted.size();
+  return true;
+}
+
+bool read(const std::string& path, std::vector<Record>& out) {
+  Mapping m;
+  if (!map(path, m)) return false;
+  out.insert(out.end(), m.begin(), m.end());
+  return true;
+}
+
+bool append(const std::string& path, const std::vector<Record>& records) {
+  std::string out;
+  {
+    std::ifstream existing(path, std::ios::binary);
+    char header[HEADER_BYTES];
+    if (!existing || !existing.read(header, HEADER_BYTES)) {
+      out = "HXTD";
+      put_u32(out, DATASET_VERSION);
+    } else if (get_u32(reinterpret_cast<const unsigned char*>(header) + 4) != DATASET_VERSION) {
+      return false;
+    }
+  }
+  out.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Record));
+  std::ofstream f(path, std::ios::binary | std::ios::app);
+  if (!f) return false;
+  f.write(out.data(), static_cast<std::streamsize>(out.size()));
+  return static_cast<bool>(f);
+}
+
+}  // namespace dataset
+}  // namespace hexchess
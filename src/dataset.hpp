@@ -0,0 +1,82 @@
+#pragma once
+
+#include "board.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace hexchess {
+namespace dataset {
+
+// cells in column-by-column storage order (the same for every variant)
+static constexpr int RECORD_CELLS = 91;
+// most pieces a record holds (hexofen starts with 42)
+static constexpr int MAX_PIECES = 42;
+static constexpr int OCCUPANCY_BYTES = (RECORD_CELLS + 7) / 8;
+static constexpr int PIECE_BYTES = MAX_PIECES / 2;
+static constexpr int RECORD_BYTES = 40;
+static constexpr uint8_t NO_EP = 0xFF;
+
+// training position, exactly as stored. file: "HXTD", u32 version 2, then the records,
+// little-endian. bit i of occupancy = cell i holds a piece; pieces has one nibble per occupied
+// cell in cell order (low nibble first): 1-6 white P R N B K Q, 9-14 black
+struct Record {
+  uint8_t occupancy[OCCUPANCY_BYTES];
+  uint8_t pieces[PIECE_BYTES];
+  uint8_t flags;  // bits 0-1 variant, 2 white to move, 3-4 result + 1
+  uint8_t ep;  // cell of the en passant square or NO_EP
+  uint8_t halfmove;  // clamped to 255
+  int16_t score;  // white POV centipawns
+  uint16_t fullmove;
+
+  board::Variant variant() const { return static_cast<board::Variant>(flags & 3); }
+  bool white_to_play() const { return (flags & 4) != 0; }
+  // 1 white won, 0 draw, -1 black won
+  int result() const { return ((flags >> 3) & 3) - 1; }
+  void set_result(int result) { flags = static_cast<uint8_t>((flags & 7) | ((result + 1) << 3)); }
+};
+static_assert(sizeof(Record) == RECORD_BYTES, "records are read from disk as is");
+
+struct Placed {
+  int col, storage_row;
+  board::Piece piece;
+};
+
+// nullopt if the position has more than MAX_PIECES pieces
+std::optional<Record> pack(const board::State& state, int score, int result);
+// pieces of the record in cell order. returns how many
+int pieces(const Record& record, std::array<Placed, MAX_PIECES>& out);
+// the record on a board, keys and sums refreshed. in place: no allocation (cells keep their size)
+void unpack(const Record& record, board::State& state);
+board::State unpack(const Record& record);
+
+// a file's records in memory. version 2 files are mapped read-only and used in place, version 1
+// files are converted into a buffer
+struct Mapping {
+  const Record* records = nullptr;
+  size_t count = 0;
+  const Record* begin() const { return records; }
+  const Record* end() const { return records + count; }
+
+  Mapping() = default;
+  Mapping(const Mapping&) = delete;
+  Mapping& operator=(const Mapping&) = delete;
+  ~Mapping();
+
+  void* mapped = nullptr;
+  size_t mapped_bytes = 0;
+  std::vector<Record> converted;
+};
+
+// false if the file is missing or malformed
+bool map(const std::string& path, Mapping& out);
+// appends to out. false if the file is missing or malformed
+bool read(const std::string& path, std::vector<Record>& out);
+// appends to path, writing the header if the file is new or empty. false for a version 1 file
+bool append(const std::string& path, const std::vector<Record>& records);
+
+}  // namespace dataset
+}  // namespace hexchess
@@ -1,6 +1,12 @@
 #include "eval.hpp"
 #include "board.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <vector>
 
 namespace hexchess {
 namespace eval {
@@ -17,20 +23,388 @@ int piece_value(char type) {
   }
 }
 
-int evaluate(const board::State& state) {
-  int score = 0;
+// default tables. centralization by hex distance from the middle cell, pawns by how far
+// up their column they are, king tucked in until the endgame
+static PsqTable g_psq;
+static std::once_flag g_psq_once;
+
+static const Score PIECE_SCORES[NUM_PIECE_TYPES] = {
+  {100, 120}, {480, 520}, {300, 280}, {310, 300}, {0, 0}, {900, 950}
+};
+// per step toward the center (3 - distance, so the rim is negative)
+static const Score CENTER_BONUS[NUM_PIECE_TYPES] = {
+  {4, 0}, {2, 1}, {10, 6}, {5, 4}, {-12, 12}, {2, 5}
+};
+static const Score PAWN_ADVANCE = {5, 12};
+
+static int type_index(char type) {
+  switch (type) {
+    case 'P': return 0; case 'R': return 1; case 'N': return 2;
+    case 'B': return 3; case 'K': return 4; case 'Q': return 5;
+    default: return 0;
+  }
+}
+
+// cube distance on the 91-cell board: x = col - 5, y = logical row - 5
+static int center_distance(int col, int storage_row) {
+  int x = col - 5;
+  int y = board::get_logical_row(col, storage_row) - 5;
+  return std::max(std::max(std::abs(x), std::abs(y)), std::abs(x - y));
+}
+
+// once, whichever thread evaluates first
+static void init_psq() {
+  std::call_once(g_psq_once, [] {
+    for (int v = 0; v < NUM_VARIANTS; ++v) {
+      for (int t = 0; t < NUM_PIECE_TYPES; ++t) {
+        for (int c = 0; c < board::NUM_COLS; ++c) {
+          int rows = board::max_row(static_cast<board::Variant>(v), c);
+          for (int r = 0; r < rows; ++r) {
+            int centrality = 3 - center_distance(c, r);
+            Score& cell = g_psq[v][t][c * 11 + r];
+            cell.mg = PIECE_SCORES[t].mg + centrality * CENTER_BONUS[t].mg;
+            cell.eg = PIECE_SCORES[t].eg + centrality * CENTER_BONUS[t].eg;
+            if (t == 0) {
+              cell.mg += r * PAWN_ADVANCE.mg;
+              cell.eg += r * PAWN_ADVANCE.eg;
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+Score psq(board::Variant variant, const board::Piece& p, int col, int storage_row) {
+  init_psq();
+  // columns are contiguous, so flipping a column top to bottom mirrors the board for black
+  int row = p.white ? storage_row : board::max_row(variant, col) - 1 - storage_row;
+  const Score& s = g_psq[static_cast<int>(variant)][type_index(p.type)][col * 11 + row];
+  return p.white ? s : Score{ -s.mg, -s.eg };
+}
+
+int phase_weight(char type) {
+  switch (type) {
+    case 'N': case 'B': return 1;
+    case 'R': return 2;
+    case 'Q': return 4;
+    default: return 0;
+  }
+}
+
+// attack and pawn terms, tunable like the tables
+enum TermIndex {
+  TERM_MOBILITY = 0,  // + type index
+  TERM_KING_ZONE = TERM_MOBILITY + NUM_PIECE_TYPES,
+  TERM_HANGING,
+  TERM_DOUBLED,
+  TERM_ISOLATED,
+  TERM_CONNECTED,
+  TERM_PASSED,  // + steps to the promotion cell, 0..10
+  TERM_END = TERM_PASSED + 11
+};
+static_assert(TERM_END == NUM_TERMS, "eval.hpp NUM_TERMS out of date");
+
+static Score g_terms[NUM_TERMS] = {
+  // mobility: per attacked cell that isnt our own piece, by P R N B K Q
+  {0, 0}, {2, 4}, {4, 4}, {3, 4}, {0, 0}, {1, 2},
+  // per enemy attack on the king's cell or a cell next to it
+  {-6, -1},
+  // piece the side to move can take for free
+  {-30, -30},
+  // pawn structure. columns play the part of files: doubled per extra pawn in a column,
+  // isolated (no own pawn on either neighbouring column), connected (defended by an own pawn)
+  {-10, -20}, {-10, -15}, {8, 6},
+  // passed pawn by steps left to the promotion cell
+  {0, 0}, {60, 120}, {45, 90}, {32, 65}, {22, 45}, {15, 30}, {10, 20}, {6, 12}, {4, 8}, {2, 5}, {2, 5}
+};
+
+// evaluate() adds the terms up, the tuner records them (linear_terms)
+struct ScoreSink {
+  Score s;
+  void add(int term, int n) {
+    s.mg += n * g_terms[term].mg;
+    s.eg += n * g_terms[term].eg;
+  }
+};
+struct CoefSink {
+  std::vector<ParamCoef>& out;
+  void add(int term, int n) {
+    if (n) out.push_back(ParamCoef{ PSQ_PARAMS + term, n });
+  }
+};
+
+// mobility, king zone and hanging pieces for one side, sign 1 for white
+template <typename Sink>
+static void attack_terms(const board::State& state, const attacks::AttackMap& map, bool white, Sink& sink) {
+  int sign = white ? 1 : -1;
+  const attacks::SideAttacks& own = map.side(white);
+  const attacks::SideAttacks& opp = map.side(!white);
+  for (int p = 0; p < own.num_pieces; ++p) {
+    const attacks::PieceAttacks& pa = own.pieces[static_cast<size_t>(p)];
+    int mobility = 0;
+    for (int i = 0; i < pa.num_targets; ++i) {
+      int to = pa.targets[static_cast<size_t>(i)];
+      const board::Square& sq = state.cells[static_cast<size_t>(attacks::cell_col(to))][static_cast<size_t>(attacks::cell_row(to))];
+      if (!sq || sq->white != white) mobility++;
+    }
+    sink.add(TERM_MOBILITY + type_index(pa.type), sign * mobility);
+    if (pa.type != 'K' && white != state.white_to_play && opp.attacks(pa.from) && !own.attacks(pa.from))
+      sink.add(TERM_HANGING, sign);
+  }
+  if (own.king_cell >= 0) {
+    int zone = opp.count[static_cast<size_t>(own.king_cell)];
+    const auto& ring = attacks::tables(state.variant).king[static_cast<size_t>(own.king_cell)];
+    for (const int8_t* c = ring.data(); *c >= 0; ++c) zone += opp.count[static_cast<size_t>(*c)];
+    sink.add(TERM_KING_ZONE, sign * zone);
+  }
+}
+
+// logical rows holding a pawn, per side and column
+using PawnRows = std::array<std::array<uint16_t, board::NUM_COLS>, 2>;
+
+static bool has_pawn(const PawnRows& rows, int side, int col, int logical_row) {
+  if (col < 0 || col >= board::NUM_COLS || logical_row < 0 || logical_row > 15) return false;
+  return (rows[static_cast<size_t>(side)][static_cast<size_t>(col)] >> logical_row) & 1;
+}
+
+// any pawn of side in col at a logical row in [lo, hi]
+static bool has_pawn_between(const PawnRows& rows, int side, int col, int lo, int hi) {
+  if (col < 0 || col >= board::NUM_COLS || lo > hi) return false;
+  lo = std::max(lo, 0);
+  hi = std::min(hi, 15);
+  uint32_t span = ((1u << (hi - lo + 1)) - 1) << lo;
+  return (rows[static_cast<size_t>(side)][static_cast<size_t>(col)] & span) != 0;
+}
+
+// pawn structure, white POV
+template <typename Sink>
+static void pawn_terms(const board::State& state, Sink& sink) {
+  PawnRows rows{};
+  for (int c = 0; c < board::NUM_COLS; ++c)
+    for (int r = 0; r < board::max_row(state.variant, c); ++r) {
+      const board::Square& sq = state.cells[static_cast<size_t>(c)][static_cast<size_t>(r)];
+      if (sq && sq->type == 'P')
+        rows[sq->white ? 0 : 1][static_cast<size_t>(c)] |= static_cast<uint16_t>(1u << board::get_logical_row(c, r));
+    }
   for (int c = 0; c < board::NUM_COLS; ++c) {
-    int maxr = board::max_row(state.variant, c);
-    for (int r = 0; r < maxr; ++r) {
-      auto sq = state.at(c, r);
+    for (int r = 0; r < board::max_row(state.variant, c); ++r) {
+      const board::Square& sq = state.cells[static_cast<size_t>(c)][static_cast<size_t>(r)];
+      if (!sq || sq->type != 'P') continue;
+      bool white = sq->white;
+      int side = white ? 0 : 1, other = 1 - side, sign = white ? 1 : -1;
+      int l = board::get_logical_row(c, r);
+      if (!has_pawn_between(rows, side, c - 1, 0, 15) && !has_pawn_between(rows, side, c + 1, 0, 15))
+        sink.add(TERM_ISOLATED, sign);
+      // defenders sit where an own pawn's capture lands on (c, l)
+      bool defended = white ? has_pawn(rows, side, c + 1, l) || has_pawn(rows, side, c - 1, l - 1)
+                            : has_pawn(rows, side, c + 1, l + 1) || has_pawn(rows, side, c - 1, l);
+      if (defended) sink.add(TERM_CONNECTED, sign);
+      // nothing ahead in the column, nothing that can capture on the way up
+      bool passed = white ? !has_pawn_between(rows, other, c, l + 1, 15) &&
+                                !has_pawn_between(rows, other, c + 1, l + 1, 15) &&
+                                !has_pawn_between(rows, other, c - 1, l, 15)
+                          : !has_pawn_between(rows, other, c, 0, l - 1) &&
+                                !has_pawn_between(rows, other, c + 1, 0, l) &&
+                                !has_pawn_between(rows, other, c - 1, 0, l - 1);
+      if (passed) {
+        int steps = white ? board::max_row(state.variant, c) - 1 - r : r;
+        sink.add(TERM_PASSED + std::min(std::max(steps, 0), 10), sign);
+      }
+    }
+    for (int side = 0; side < 2; ++side) {
+      int n = __builtin_popcount(rows[static_cast<size_t>(side)][static_cast<size_t>(c)]);
+      if (n > 1) sink.add(TERM_DOUBLED, (side == 0 ? 1 : -1) * (n - 1));
+    }
+  }
+}
+
+// state keys dont include the variant, cached scores depend on it (params, nets, board), so the
+// eval and pawn caches mix it in
+static constexpr uint64_t VARIANT_CACHE_KEYS[NUM_VARIANTS] = { 0, 0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL };
+
+// pawn hash: entry = high 32 bits of pawn_key | mg (16 bits) | eg (16 bits). pawn structure
+// changes on few moves, so most probes hit even in a small table
+static constexpr int PAWN_CACHE_SIZE = 1 << 16;  // 512kb
+static constexpr uint64_t PAWN_KEY_CHECK_MASK = 0xFFFFFFFF00000000ULL;
+
+static std::atomic<uint64_t> g_pawn_cache[PAWN_CACHE_SIZE];
+static thread_local CacheStats g_pawn_stats;  // per thread, like the eval cache's
+
+static Score pawn_terms_cached(const board::State& state) {
+  uint64_t key = state.pawn_key ^ VARIANT_CACHE_KEYS[static_cast<int>(state.variant)];
+  std::atomic<uint64_t>& slot = g_pawn_cache[key & (PAWN_CACHE_SIZE - 1)];
+  uint64_t entry = slot.load(std::memory_order_relaxed);
+  g_pawn_stats.probes++;
+  if (entry != 0 && (entry & PAWN_KEY_CHECK_MASK) == (key & PAWN_KEY_CHECK_MASK)) {
+    g_pawn_stats.hits++;
+    return Score{ static_cast<int16_t>(entry >> 16), static_cast<int16_t>(entry & 0xFFFF) };
+  }
+  ScoreSink sink;
+  pawn_terms(state, sink);
+  Score s = sink.s;
+  uint64_t packed = (static_cast<uint64_t>(static_cast<uint16_t>(s.mg)) << 16) | static_cast<uint16_t>(s.eg);
+  slot.store((key & PAWN_KEY_CHECK_MASK) | packed, std::memory_order_relaxed);
+  return s;
+}
+
+int evaluate(const board::State& state) {
+  attacks::AttackMap map(state);
+  return evaluate(state, map);
+}
+
+int evaluate(const board::State& state, const attacks::AttackMap& map) {
+  if (nnue::active(state.variant) && state.nnue.king[0] >= 0 && state.nnue.king[1] >= 0)
+    return nnue::evaluate(state);
+  ScoreSink sink;
+  attack_terms(state, map, true, sink);
+  attack_terms(state, map, false, sink);
+  Score pawns = pawn_terms_cached(state);
+  int mg = state.psq_mg + sink.s.mg + pawns.mg;
+  int eg = state.psq_eg + sink.s.eg + pawns.eg;
+  int phase = std::min(state.phase, MAX_PHASE);
+  return (mg * phase + eg * (MAX_PHASE - phase)) / MAX_PHASE;
+}
+
+void linear_terms(const board::State& state, const attacks::AttackMap& map, std::vector<ParamCoef>& out) {
+  size_t first = out.size();
+  for (int c = 0; c < board::NUM_COLS; ++c)
+    for (int r = 0; r < board::max_row(state.variant, c); ++r) {
+      const board::Square& sq = state.cells[static_cast<size_t>(c)][static_cast<size_t>(r)];
       if (!sq) continue;
-      int v = piece_value(sq->type);
-      if (sq->white) score += v; else score -= v;
+      int row = sq->white ? r : board::max_row(state.variant, c) - 1 - r;
+      int index = (static_cast<int>(state.variant) * NUM_PIECE_TYPES + type_index(sq->type)) * PSQ_CELLS + c * 11 + row;
+      out.push_back(ParamCoef{ index, sq->white ? 1 : -1 });
     }
+  CoefSink sink{ out };
+  attack_terms(state, map, true, sink);
+  attack_terms(state, map, false, sink);
+  pawn_terms(state, sink);
+  // one entry per index
+  std::sort(out.begin() + static_cast<std::ptrdiff_t>(first), out.end(),
+      [](const ParamCoef& a, const ParamCoef& b) { return a.index < b.index; });
+  size_t n = first;
+  for (size_t i = first; i < out.size(); ++i) {
+    if (n > first && out[n - 1].index == out[i].index)
+      out[n - 1].coef += out[i].coef;
+    else
+      out[n++] = out[i];
   }
+  out.resize(n);
+  out.erase(std::remove_if(out.begin() + static_cast<std::ptrdiff_t>(first), out.end(),
+      [](const ParamCoef& p) { return p.coef == 0; }), out.end());
+}
+
+std::vector<Score> get_params() {
+  init_psq();
+  std::vector<Score> params;
+  params.reserve(NUM_PARAMS);
+  for (const auto& variant : g_psq)
+    for (const auto& piece : variant)
+      params.insert(params.end(), piece.begin(), piece.end());
+  params.insert(params.end(), g_terms, g_terms + NUM_TERMS);
+  return params;
+}
+
+void set_params(const std::vector<Score>& params) {
+  init_psq();
+  size_t i = 0;
+  for (auto& variant : g_psq)
+    for (auto& piece : variant)
+      for (Score& cell : piece) cell = params[i++];
+  for (Score& term : g_terms) term = params[i++];
+  clear_cache();
+}
+
+// version 1 held the psq tables only
+static constexpr uint32_t PARAMS_VERSION = 2;
+
+static void put_u32(std::string& out, uint32_t v) {
+  for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+bool load_params(const std::string& path) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f) return false;
+  std::string data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+  const auto* p = reinterpret_cast<const unsigned char*>(data.data());
+  if (data.size() < 12 || data.compare(0, 4, "HXEV") != 0) return false;
+  uint32_t version = get_u32(p + 4), count = get_u32(p + 8);
+  uint32_t expected = version == 1 ? PSQ_PARAMS : NUM_PARAMS;
+  if ((version != 1 && version != PARAMS_VERSION) || count != expected ||
+      data.size() != 12 + static_cast<size_t>(count) * 4)
+    return false;
+  std::vector<Score> params = get_params();
+  p += 12;
+  for (uint32_t i = 0; i < count; ++i, p += 4) {
+    params[i].mg = static_cast<int16_t>(p[0] | (p[1] << 8));
+    params[i].eg = static_cast<int16_t>(p[2] | (p[3] << 8));
+  }
+  set_params(params);
+  return true;
+}
+
+bool save_params(const std::string& path) {
+  std::string out = "HXEV";
+  put_u32(out, PARAMS_VERSION);
+  put_u32(out, static_cast<uint32_t>(NUM_PARAMS));
+  for (const Score& s : get_params()) {
+    for (int v : { s.mg, s.eg }) {
+      uint16_t u = static_cast<uint16_t>(static_cast<int16_t>(v));
+      out.push_back(static_cast<char>(u & 0xFF));
+      out.push_back(static_cast<char>(u >> 8));
+    }
+  }
+  std::ofstream f(path, std::ios::binary);
+  if (!f) return false;
+  f.write(out.data(), static_cast<std::streamsize>(out.size()));
+  return static_cast<bool>(f);
+}
+
+// entry = high 32 bits of the key | score. one word, so a racing write cant tear it.
+// index takes the low bits, so a hit matches 32 + log2(size) key bits
+static constexpr int EVAL_CACHE_SIZE = 1 << 16;  // 512kb
+static constexpr uint64_t KEY_CHECK_MASK = 0xFFFFFFFF00000000ULL;
+
+static std::atomic<uint64_t> g_eval_cache[EVAL_CACHE_SIZE];
+// per thread: a shared counter would be contended on every probe
+static thread_local CacheStats g_cache_stats;
+
+int evaluate_cached(const board::State& state) {
+  attacks::AttackMap map(state);
+  return evaluate_cached(state, map);
+}
+
+int evaluate_cached(const board::State& state, const attacks::AttackMap& map) {
+  uint64_t key = state.hash() ^ VARIANT_CACHE_KEYS[static_cast<int>(state.variant)];
+  std::atomic<uint64_t>& slot = g_eval_cache[key & (EVAL_CACHE_SIZE - 1)];
+  uint64_t entry = slot.load(std::memory_order_relaxed);
+  g_cache_stats.probes++;
+  if (entry != 0 && (entry & KEY_CHECK_MASK) == (key & KEY_CHECK_MASK)) {
+    g_cache_stats.hits++;
+    return static_cast<int32_t>(static_cast<uint32_t>(entry));
+  }
+  int score = evaluate(state, map);
+  slot.store((key & KEY_CHECK_MASK) | static_cast<uint32_t>(score), std::memory_order_relaxed);
   return score;
 }
 
+CacheStats cache_stats() { return g_cache_stats; }
+
+CacheStats pawn_cache_stats() { return g_pawn_stats; }
+
+void clear_cache() {
+  for (auto& slot : g_eval_cache) slot.store(0, std::memory_order_relaxed);
+  for (auto& slot : g_pawn_cache) slot.store(0, std::memory_order_relaxed);
+  g_cache_stats = CacheStats{};
+  g_pawn_stats = CacheStats{};
+}
+
 bool is_terminal(const board::State& state, const board::Move& move_just_made) {
   auto captured = state.white_to_play ? state.at(move_just_made.to_col, move_just_made.to_row) : std::optional<board::Piece>{};
   (void)state;
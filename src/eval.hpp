@@ -1,6 +1,11 @@
 #pragma once
 
 #include "board.hpp"
+#include "attacks.hpp"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 namespace hexchess {
 namespace eval {
@@ -8,8 +13,71 @@ namespace eval {
 // P=1 R=5 N=3 B=3 K=0 Q=9 (same as gui)
 int piece_value(char type);
 
-// positive = white better
+// midgame / endgame pair
+struct Score {
+  int mg = 0;
+  int eg = 0;
+};
+
+// piece-square tables, centipawns, material included. white's view: [variant][piece][cell],
+// piece P R N B K Q, cell = col * 11 + storage row. black reads the column mirrored
+static constexpr int NUM_VARIANTS = 3;
+static constexpr int NUM_PIECE_TYPES = 6;
+static constexpr int PSQ_CELLS = board::NUM_COLS * 11;
+using PsqTable = std::array<std::array<std::array<Score, PSQ_CELLS>, NUM_PIECE_TYPES>, NUM_VARIANTS>;
+
+// material + piece-square value of p on (col, storage row), white POV (black negative).
+// State sums these incrementally
+Score psq(board::Variant variant, const board::Piece& p, int col, int storage_row);
+
+// game phase: MAX_PHASE with Glinski's full set (more clamps), 0 with only kings and pawns
+static constexpr int MAX_PHASE = 26;
+int phase_weight(char type);
+
+// positive = white better, centipawns. psq sums, mobility, king zone and hanging pieces
+// from the attack map, pawn structure (pawn hash keyed by state.pawn_key), mg and eg
+// blended by phase. a loaded nnue net for the variant replaces all of it
 int evaluate(const board::State& state);
+int evaluate(const board::State& state, const attacks::AttackMap& map);
+
+// every tunable value as one array of mg/eg pairs: the psq tables flattened, then the
+// NUM_TERMS attack and pawn terms (mobility by piece, king zone, hanging, doubled, isolated,
+// connected, passed by steps to promotion)
+static constexpr int NUM_TERMS = 22;
+static constexpr int PSQ_PARAMS = NUM_VARIANTS * NUM_PIECE_TYPES * PSQ_CELLS;
+static constexpr int NUM_PARAMS = PSQ_PARAMS + NUM_TERMS;
+std::vector<Score> get_params();
+// NUM_PARAMS values. clears the caches; states built before need State::refresh()
+void set_params(const std::vector<Score>& params);
+
+// the classical evaluate() as a linear function: mg = sum coef * params[index].mg, same for
+// eg, then the phase blend. appends one entry per index used
+struct ParamCoef {
+  int index;
+  int coef;
+};
+void linear_terms(const board::State& state, const attacks::AttackMap& map, std::vector<ParamCoef>& out);
+
+// binary parameter file: "HXEV", u32 version, u32 entry count, then get_params() as
+// little-endian int16 mg/eg pairs. version 1 files (psq tables only) still load.
+// loading clears the eval cache; states built before need State::refresh()
+bool load_params(const std::string& path);
+bool save_params(const std::string& path);
+
+// evaluate through a direct-mapped cache keyed by state.key. lock-free, shared by all threads.
+// the map is only built on a miss
+int evaluate_cached(const board::State& state);
+int evaluate_cached(const board::State& state, const attacks::AttackMap& map);
+
+struct CacheStats {
+  uint64_t probes = 0;
+  uint64_t hits = 0;
+};
+// the calling thread's probes since it started (or last cleared)
+CacheStats cache_stats();
+CacheStats pawn_cache_stats();
+// both the eval and the pawn cache, and the calling thread's counts
+void clear_cache();
 
 // was last move king capture
 bool is_terminal(const board::State& state, const board::Move& move_just_made);
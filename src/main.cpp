@@ -1,14 +1,23 @@
 #include "board.hpp"
 #include "moves.hpp"
 #include "eval.hpp"
+#include "nnue.hpp"
 #include "search.hpp"
 #include "protocol.hpp"
 #include "gephi.hpp"
+#include "tune.hpp"
+#include "selfplay.hpp"
+#include "match.hpp"
+#include "suite.hpp"
+#include "analyze.hpp"
+#include "book.hpp"
+#include "tablebase.hpp"
 #include <algorithm>
 #include <atomic>
 #include <cstdlib>
 #include <chrono>
 #include <cctype>
+#include <condition_variable>
 #include <filesystem>
 #include <iomanip>
 #include <iostream>
@@ -57,9 +66,19 @@ static std::string format_game_timestamp(std::chrono::system_clock::time_point t
 // IO thread reads stdin so we can ponder while waiting
 static std::queue<std::string> g_input_queue;
 static std::mutex g_queue_mutex;
+static std::condition_variable g_queue_cv;
 static std::atomic<bool> g_quit_requested{false};
 static std::atomic<bool> g_io_thread_done{false};
 
+// one search runs at a time (main or ponder thread), they share this
+static hexchess::search::SearchControl g_search;
+
+static void request_quit() {
+  g_quit_requested = true;
+  g_search.stop = true;
+  g_queue_cv.notify_all();
+}
+
 // GUI sends heartbeat every 0.5s; we quit after 5 missed
 static constexpr int HEARTBEAT_INTERVAL_MS = 500;
 static constexpr int HEARTBEAT_FAIL_COUNT = 5;
@@ -78,7 +97,7 @@ static void heartbeat_watcher_thread_func() {
     std::lock_guard<std::mutex> lock(g_heartbeat_mutex);
     if (now - g_last_heartbeat >= std::chrono::milliseconds(HEARTBEAT_INTERVAL_MS)) {
       if (++g_heartbeat_failed_checks >= HEARTBEAT_FAIL_COUNT) {
-        g_quit_requested = true;
+        request_quit();
         break;
       }
     } else {
@@ -86,7 +105,7 @@ static void heartbeat_watcher_thread_func() {
     }
     // idle timeout - no input at all
     if (now - g_last_activity >= std::chrono::milliseconds(IDLE_TIMEOUT_MS)) {
-      g_quit_requested = true;
+      request_quit();
       break;
     }
   }
@@ -96,42 +115,82 @@ static void io_thread_func() {
   std::string line;
   while (!g_quit_requested && std::getline(std::cin, line)) {
     while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) line.pop_back();
-    std::lock_guard<std::mutex> lock(g_queue_mutex);
-    g_input_queue.push(std::move(line));
+    {
+      // stamped here, main can be blocked in a long search
+      std::lock_guard<std::mutex> hb_lock(g_heartbeat_mutex);
+      auto now = std::chrono::steady_clock::now();
+      g_last_activity = now;
+      if (line == "heartbeat") {
+        g_last_heartbeat = now;
+        g_heartbeat_failed_checks = 0;
+        continue;
+      }
+    }
+    // abort a running search right away, main only sees the queue after it returns
+    if (line == "quit" || line == "stop") g_search.stop = true;
+    {
+      std::lock_guard<std::mutex> lock(g_queue_mutex);
+      g_input_queue.push(std::move(line));
+    }
+    g_queue_cv.notify_one();
   }
   g_io_thread_done = true;
+  g_queue_cv.notify_one();
 }
 
-static std::string get_next_line(bool opponent_to_play, std::unique_ptr<hexchess::search::Node>* ponder_root) {
+static std::string get_next_line() {
+  std::unique_lock<std::mutex> lock(g_queue_mutex);
   while (true) {
     if (g_quit_requested) return "quit";
-    {
-      std::lock_guard<std::mutex> lock(g_queue_mutex);
-      if (!g_input_queue.empty()) {
-        std::string line = std::move(g_input_queue.front());
-        g_input_queue.pop();
-        {
-          std::lock_guard<std::mutex> hb_lock(g_heartbeat_mutex);
-          g_last_activity = std::chrono::steady_clock::now();
-        }
-        return line;
-      }
+    if (!g_input_queue.empty()) {
+      std::string line = std::move(g_input_queue.front());
+      g_input_queue.pop();
+      return line;
     }
     if (g_io_thread_done) return "quit";
-
-    if (opponent_to_play && ponder_root && *ponder_root) {
-      // ponder with big node budget, stop when input shows up
-      const int ponder_nodes = 100000;
-      hexchess::search::iterative_deepen(**ponder_root, ponder_nodes, []() {
-        std::lock_guard<std::mutex> lock(g_queue_mutex);
-        return !g_input_queue.empty() || g_quit_requested;
-      });
-    } else {
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
+    // io thread notifies as soon as a line is queued
+    g_queue_cv.wait_for(lock, std::chrono::milliseconds(10));
   }
 }
 
+// search reports info itself only once not pondering, main is blocked meanwhile
+static void print_info(const hexchess::search::SearchInfo& info) {
+  std::cout << hexchess::protocol::format_info(info) << std::endl;
+}
+
+// ponder runs on its own thread while the main loop waits for the player's move
+static std::thread g_ponder_thread;
+
+// limits only apply after ponderhit (clock starts then)
+static void start_ponder(hexchess::search::Node& ponder_root, const hexchess::search::SearchLimits& limits) {
+  g_search.stop = g_quit_requested.load();
+  g_search.pondering = true;
+  g_ponder_thread = std::thread([&ponder_root, limits]() {
+    hexchess::search::iterative_deepen(ponder_root, limits, &g_search, print_info);
+  });
+}
+
+// ponderhit: search continues on the real budget. otherwise aborted
+static void finish_ponder(bool hit) {
+  if (!g_ponder_thread.joinable()) return;
+  if (hit) g_search.pondering = false;
+  else g_search.stop = true;
+  g_ponder_thread.join();
+  g_search.pondering = false;
+}
+
+static bool same_move(const hexchess::board::Move& a, const hexchess::board::Move& b) {
+  return a.from_col == b.from_col && a.from_row == b.from_row &&
+         a.to_col == b.to_col && a.to_row == b.to_row;
+}
+
+// parsed moves carry no promotion/capture flags, take them from the generated move on the same squares
+static std::optional<hexchess::board::Move> generated_move(const hexchess::board::State& state, const hexchess::board::Move& parsed) {
+  for (const hexchess::board::Move& m : hexchess::moves::generate(state))
+    if (same_move(m, parsed)) return m;
+  return std::nullopt;
+}
+
 int main(int argc, char** argv) {
 #ifdef _WIN32
   // binary mode when piped (avoids line ending mess)
@@ -140,6 +199,48 @@ int main(int argc, char** argv) {
     _setmode(_fileno(stdout), _O_BINARY);
   }
 #endif
+  // engine tune / selfplay / match / suite / analyze / book / tablebase ...: tools instead of playing (tune.hpp,
+  // selfplay.hpp, match.hpp, suite.hpp, analyze.hpp, book.hpp, tablebase.hpp)
+  if (argc > 1 && std::string(argv[1]) == "tune") return hexchess::tune::run(argc - 2, argv + 2);
+  if (argc > 1 && std::string(argv[1]) == "selfplay") return hexchess::selfplay::run(argc - 2, argv + 2);
+  if (argc > 1 && std::string(argv[1]) == "match") return hexchess::match::run(argc - 2, argv + 2);
+  if (argc > 1 && std::string(argv[1]) == "suite") return hexchess::suite::run(argc - 2, argv + 2);
+  if (argc > 1 && std::string(argv[1]) == "analyze") return hexchess::analyze::run(argc - 2, argv + 2);
+  if (argc > 1 && std::string(argv[1]) == "book") return hexchess::book::run(argc - 2, argv + 2);
+  if (argc > 1 && std::string(argv[1]) == "tablebase") return hexchess::tablebase::run(argc - 2, argv + 2);
+
+  // --params <file>: eval tables to use. --dump-params <file>: write the defaults and exit.
+  // --nnue <file>: network for the variant named in the file, may be repeated.
+  // --book <file>: opening book to play from before searching.
+  // --tablebases <dir>: endgame tables the search probes.
+  // --no-ponder / --no-export: no thinking on the opponent's time, no gephi files (engine matches)
+  bool ponder_enabled = true, export_enabled = true;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--no-ponder") ponder_enabled = false;
+    if (arg == "--no-export") export_enabled = false;
+  }
+  for (int i = 1; i + 1 < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--params" && !hexchess::eval::load_params(argv[i + 1])) {
+      std::cerr << "invalid params file " << argv[i + 1] << std::endl;
+      return 1;
+    }
+    if (arg == "--dump-params") return hexchess::eval::save_params(argv[i + 1]) ? 0 : 1;
+    if (arg == "--nnue" && !hexchess::nnue::load_network(argv[i + 1])) {
+      std::cerr << "invalid network file " << argv[i + 1] << std::endl;
+      return 1;
+    }
+    if (arg == "--book" && !hexchess::book::load(argv[i + 1])) {
+      std::cerr << "invalid book file " << argv[i + 1] << std::endl;
+      return 1;
+    }
+    if (arg == "--tablebases" && hexchess::tablebase::load(argv[i + 1]) < 0) {
+      std::cerr << "invalid tablebase in " << argv[i + 1] << std::endl;
+      return 1;
+    }
+  }
+
   std::string exe_dir = get_executable_dir();
   hexchess::gephi::set_export_base_dir(exe_dir);
 
@@ -153,7 +254,9 @@ int main(int argc, char** argv) {
   std::optional<hexchess::board::State> state_opt;
   std::unique_ptr<hexchess::search::Node> root;
   std::unique_ptr<hexchess::search::Node> ponder_root;
-  int max_nodes = 3000;  // default, can overriden by trailing number on first cmd
+  std::optional<hexchess::board::Move> ponder_move;  // predicted reply, ponder_root is after it
+  hexchess::search::SearchLimits limits;
+  limits.max_nodes = 3000;  // default, can overriden by trailing number on first cmd or go
 
   std::thread io_thread(io_thread_func);
 
@@ -165,10 +268,76 @@ int main(int argc, char** argv) {
   }
   std::thread heartbeat_watcher_thread(heartbeat_watcher_thread_func);
 
+  // ponder the position after the predicted reply (pv second move), or the
+  // opponent-to-move position if there is no prediction. call before root->children is cleared
+  auto begin_ponder = [&](const hexchess::board::Move& engine_move) {
+    ponder_move = std::nullopt;
+    if (!ponder_enabled) return;
+    if (root->pv.size() >= 2 && same_move(root->pv[0], engine_move))
+      ponder_move = root->pv[1];
+    else if (hexchess::search::Node* child = hexchess::search::find_child(*root, engine_move))
+      ponder_move = child->best_move;
+    ponder_root = std::make_unique<hexchess::search::Node>();
+    ponder_root->state = root->state;
+    ponder_root->history = root->history;
+    ponder_root->history.push_back(ponder_root->state.key);
+    ponder_root->state.make_move(engine_move);
+    auto ponder_limits = limits;
+    if (ponder_move) {
+      ponder_root->history.push_back(ponder_root->state.key);
+      ponder_root->state.make_move(*ponder_move);
+    } else {
+      ponder_limits.contempt = -limits.contempt;  // opponent to move at the ponder root
+    }
+    start_ponder(*ponder_root, ponder_limits);
+  };
+
+  // search (unless root already has a reused result or the book knows the position), export,
+  // print and play the engine move
+  auto engine_move = [&](bool search) {
+    if (auto book_move = hexchess::book::probe(root->state)) {
+      std::cout << "info book " << hexchess::protocol::format_move(*book_move) << std::endl;
+      root->best_move = book_move;
+      root->pv = { *book_move };
+      root->children.clear();
+      search = false;
+    }
+    if (search) {
+      std::cout << "thinking....." << std::endl;
+      g_search.stop = g_quit_requested.load();
+      auto search_limits = limits;
+      if (!export_enabled) search_limits.record_plies = 0;
+      hexchess::search::iterative_deepen(*root, search_limits, &g_search, print_info);
+    }
+    engine_response_count++;
+    if (export_enabled) {
+      std::string gephi_path = "gephi_exports/" + format_game_timestamp(game_start_time) + " - Move " + std::to_string(engine_response_count) + ".gexf";
+      hexchess::gephi::export_tree(*root, gephi_path);
+    }
+    if (root->best_move) {
+      const auto& mv = *root->best_move;
+      auto eng_piece = root->state.at(mv.from_col, mv.from_row);
+      auto eng_captured = root->state.at(mv.to_col, mv.to_row);
+      char eng_pt = eng_piece ? eng_piece->type : 'P';
+      std::optional<char> eng_cap_type = eng_captured ? std::optional<char>(eng_captured->type) : std::nullopt;
+      std::string eng_move_str = mv.en_passant
+          ? hexchess::protocol::format_move_ep(mv, engine_plays_white)
+          : hexchess::protocol::format_move_long(mv, eng_pt, eng_cap_type);
+      std::cout << "Engine Move (" << (engine_plays_white ? "White" : "Black") << "): " << eng_move_str << std::endl;
+      begin_ponder(mv);
+      root->history.push_back(root->state.key);
+      root->state.make_move(mv);
+      root->best_move = std::nullopt;
+      root->children.clear();
+    } else {
+      std::cout << "Engine Move (" << (engine_plays_white ? "White" : "Black") << "): (none)" << std::endl;
+    }
+  };
+
   while (true) {
     bool opponent_to_play = have_board && root &&
         ((engine_plays_white && !root->state.white_to_play) || (!engine_plays_white && root->state.white_to_play));
-    line = get_next_line(opponent_to_play, &ponder_root);
+    line = get_next_line();
 
     // trim so " glinski white 3000 " works
     while (!line.empty() && (line.front() == ' ' || line.front() == '\t')) line.erase(0, 1);
@@ -177,81 +346,110 @@ int main(int argc, char** argv) {
     if (line.empty()) continue;
 
     if (line == "quit") {
-      g_quit_requested = true;
+      request_quit();
       break;
     }
 
-    if (line == "heartbeat") {
-      std::lock_guard<std::mutex> lock(g_heartbeat_mutex);
-      g_last_heartbeat = std::chrono::steady_clock::now();
-      g_heartbeat_failed_checks = 0;
+    // handled by the io thread (aborts the running search)
+    if (line == "stop") continue;
+
+    try {
+    // go <limits>: applies to every following search. searches now if it's the engine's turn
+    if (line == "go" || line.rfind("go ", 0) == 0) {
+      auto go = hexchess::protocol::parse_go(line);
+      if (!go) {
+        std::cerr << "invalid go" << std::endl;
+        continue;
+      }
+      // no limit on the line (bare go, go contempt N): the previous ones stay
+      if (!go->infinite && go->wtime_ms == 0 && go->btime_ms == 0 && go->movetime_ms == 0 && go->max_nodes == 0 &&
+          go->max_depth == 0) {
+        go->wtime_ms = limits.wtime_ms;
+        go->btime_ms = limits.btime_ms;
+        go->winc_ms = limits.winc_ms;
+        go->binc_ms = limits.binc_ms;
+        go->movetime_ms = limits.movetime_ms;
+        go->max_nodes = limits.max_nodes;
+        go->max_depth = limits.max_depth;
+      }
+      limits = *go;
+      if (have_board && root && !opponent_to_play) engine_move(true);
       continue;
     }
 
-    try {
     if (!have_board) {
       std::string lower;
       lower.resize(line.size());
       std::transform(line.begin(), line.end(), lower.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+      // optional opening: "glinski white moves a2a3 f7f6" plays the moves from the start position first
+      std::vector<std::string> start_moves;
+      auto moves_pos = lower.find(" moves ");
+      if (moves_pos != std::string::npos) {
+        std::istringstream iss(lower.substr(moves_pos + 7));
+        for (std::string tok; iss >> tok;) start_moves.push_back(tok);
+        lower.erase(moves_pos);
+      }
+      // one-line positions end in the move counters, which are not node counts
+      auto one_line = hexchess::protocol::parse_position(line);
       // optional trailing node count: "glinski white 5000" -> max_nodes 5000
       std::string cmd = lower;
       auto pos = cmd.rfind(' ');
-      if (pos != std::string::npos && pos + 1 < cmd.size()) {
+      if (!one_line && pos != std::string::npos && pos + 1 < cmd.size()) {
         std::string suffix = cmd.substr(pos + 1);
         if (!suffix.empty() && std::all_of(suffix.begin(), suffix.end(), [](unsigned char c) { return std::isdigit(c); })) {
           try {
             int n = std::stoi(suffix);
             if (n > 0) {
-              max_nodes = n;
+              limits.max_nodes = n;
               cmd = cmd.substr(0, pos);
               while (!cmd.empty() && cmd.back() == ' ') cmd.pop_back();
             }
           } catch (...) {}
         }
       }
+      // opening moves must be pseudo-legal in turn, flags come from the generated move
+      auto play_start_moves = [&]() {
+        for (const std::string& tok : start_moves) {
+          auto parsed = hexchess::protocol::parse_move(tok);
+          auto move = parsed ? generated_move(root->state, *parsed) : std::nullopt;
+          if (!move) return false;
+          root->history.push_back(root->state.key);
+          root->state.make_move(*move);
+        }
+        return true;
+      };
       auto start_engine_white = [&](const char* pos_name) {
+        if (!play_start_moves()) {
+          std::cerr << "invalid move" << std::endl;
+          root.reset();
+          return;
+        }
         have_board = true;
         if (!game_start_time_set) {
           game_start_time = std::chrono::system_clock::now();
           game_start_time_set = true;
         }
         engine_plays_white = true;
-        std::cout << "position " << pos_name << " (white to move) max nodes " << max_nodes << std::endl;
-        std::cout << "thinking....." << std::endl;
+        std::cout << "position " << pos_name << " (" << (root->state.white_to_play ? "white" : "black")
+                  << " to move) max nodes " << limits.max_nodes << std::endl;
         std::cout.flush();
-        hexchess::search::iterative_deepen(*root, max_nodes, []() { return false; });
-        engine_response_count++;
-        std::string gephi_path = "gephi_exports/" + format_game_timestamp(game_start_time) + " - Move " + std::to_string(engine_response_count) + ".gexf";
-        hexchess::gephi::export_tree(*root, gephi_path);
-        if (root->best_move) {
-          const auto& mv = *root->best_move;
-          auto piece = root->state.at(mv.from_col, mv.from_row);
-          auto captured = root->state.at(mv.to_col, mv.to_row);
-          char pt = piece ? piece->type : 'P';
-          std::optional<char> cap_type = captured ? std::optional<char>(captured->type) : std::nullopt;
-          std::string eng_move_str = mv.en_passant
-              ? hexchess::protocol::format_move_ep(mv, true)
-              : hexchess::protocol::format_move_long(mv, pt, cap_type);
-          std::cout << "Engine Move (White): " << eng_move_str << std::endl;
-          root->state.make_move(mv);
-          root->best_move = std::nullopt;
-          root->children.clear();
-        } else {
-          std::cout << "Engine Move (White): (none)" << std::endl;
-        }
-        ponder_root = std::make_unique<hexchess::search::Node>();
-        ponder_root->state = root->state;
+        if (root->state.white_to_play) engine_move(true);
       };
       auto start_position = [&](const char* pos_name) {
+        if (!play_start_moves()) {
+          std::cerr << "invalid move" << std::endl;
+          root.reset();
+          return;
+        }
         have_board = true;
         if (!game_start_time_set) {
           game_start_time = std::chrono::system_clock::now();
           game_start_time_set = true;
         }
-        std::cout << "position " << pos_name << " (white to move) max nodes " << max_nodes << std::endl;
+        std::cout << "position " << pos_name << " (" << (root->state.white_to_play ? "white" : "black")
+                  << " to move) max nodes " << limits.max_nodes << std::endl;
         std::cout.flush();
-        ponder_root = std::make_unique<hexchess::search::Node>();
-        ponder_root->state = root->state;
+        if (!root->state.white_to_play) engine_move(true);
       };
       if (cmd == "glinski white") {
         root = std::make_unique<hexchess::search::Node>();
@@ -277,6 +475,17 @@ int main(int argc, char** argv) {
         root = std::make_unique<hexchess::search::Node>();
         root->state.set_hexofen();
         start_position("hexofen");
+      } else if (one_line) {
+        // one-line position: the engine plays the side to move, on "go"
+        root = std::make_unique<hexchess::search::Node>();
+        root->state = *one_line;
+        have_board = true;
+        if (!game_start_time_set) {
+          game_start_time = std::chrono::system_clock::now();
+          game_start_time_set = true;
+        }
+        engine_plays_white = root->state.white_to_play;
+        std::cout << "position " << hexchess::protocol::format_position(root->state) << std::endl;
       } else {
         board_lines.push_back(line);
         if (board_lines.size() == 12) {
@@ -293,8 +502,6 @@ int main(int argc, char** argv) {
           }
           root = std::make_unique<hexchess::search::Node>();
           root->state = *state_opt;
-          ponder_root = std::make_unique<hexchess::search::Node>();
-          ponder_root->state = root->state;
         }
       }
       continue;
@@ -317,9 +524,15 @@ int main(int argc, char** argv) {
       std::cerr << "invalid move" << std::endl;
       continue;
     }
+    if (auto generated = generated_move(root->state, *move_opt)) move_opt = generated;
 
-    // try to reuse ponder tree
-    hexchess::search::Node* ponder_child = ponder_root ? hexchess::search::find_child(*ponder_root, *move_opt) : nullptr;
+    // ponderhit: let the running search finish on the real budget. miss: abort it
+    bool ponder_hit = ponder_move && same_move(*ponder_move, *move_opt);
+    finish_ponder(ponder_hit);
+
+    // no prediction: try to reuse the ponder tree of the opponent-to-move position
+    hexchess::search::Node* ponder_child = (ponder_root && !ponder_move)
+        ? hexchess::search::find_child(*ponder_root, *move_opt) : nullptr;
 
     // who just moved (white_to_play = who moved)
     bool player_played_white = root->state.white_to_play;
@@ -332,12 +545,16 @@ int main(int argc, char** argv) {
         : hexchess::protocol::format_move_long(*move_opt, pt, cap_type);
     std::cout << "Player Move (" << (player_played_white ? "White" : "Black") << "): " << player_notation << std::endl;
 
+    root->history.push_back(root->state.key);
     root->state.make_move(*move_opt);
     root->children.clear();
     root->best_move = std::nullopt;
 
     bool reused_ponder = false;
-    if (ponder_child) {
+    if (ponder_hit) {
+      root = std::move(ponder_root);
+      reused_ponder = root->best_move.has_value();
+    } else if (ponder_child) {
       root->state = ponder_child->state;
       root->children = std::move(ponder_child->children);
       root->best_move = ponder_child->best_move;
@@ -345,32 +562,9 @@ int main(int argc, char** argv) {
       reused_ponder = root->best_move.has_value();
     }
     ponder_root.reset();
+    ponder_move = std::nullopt;
 
-    if (!reused_ponder) {
-      std::cout << "thinking....." << std::endl;
-      hexchess::search::iterative_deepen(*root, max_nodes, []() { return false; });
-    }
-    engine_response_count++;
-    std::string gephi_path = "gephi_exports/" + format_game_timestamp(game_start_time) + " - Move " + std::to_string(engine_response_count) + ".gexf";
-    hexchess::gephi::export_tree(*root, gephi_path);
-    if (root->best_move) {
-      const auto& mv = *root->best_move;
-      auto eng_piece = root->state.at(mv.from_col, mv.from_row);
-      auto eng_captured = root->state.at(mv.to_col, mv.to_row);
-      char eng_pt = eng_piece ? eng_piece->type : 'P';
-      std::optional<char> eng_cap_type = eng_captured ? std::optional<char>(eng_captured->type) : std::nullopt;
-      std::string eng_move_str = mv.en_passant
-          ? hexchess::protocol::format_move_ep(mv, engine_plays_white)
-          : hexchess::protocol::format_move_long(mv, eng_pt, eng_cap_type);
-      std::cout << "Engine Move (" << (engine_plays_white ? "White" : "Black") << "): " << eng_move_str << std::endl;
-      root->state.make_move(mv);
-      root->best_move = std::nullopt;
-      root->children.clear();
-      ponder_root = std::make_unique<hexchess::search::Node>();
-      ponder_root->state = root->state;
-    } else {
-      std::cout << "Engine Move (" << (engine_plays_white ? "White" : "Black") << "): (none)" << std::endl;
-    }
+    engine_move(!reused_ponder);
     } catch (const std::exception& e) {
       std::cerr << "Error: " << e.what() << std::endl;
     } catch (...) {
@@ -379,6 +573,7 @@ int main(int argc, char** argv) {
   }
 
   g_quit_requested = true;
+  finish_ponder(false);
   if (heartbeat_watcher_thread.joinable()) heartbeat_watcher_thread.join();
   if (io_thread.joinable()) io_thread.join();
 
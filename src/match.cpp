@@ -0,0 +1,486 @@
+#include "match.hpp"
+#include "attacks.hpp"
+#include "board.hpp"
+#include "moves.hpp"
+#include "protocol.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace hexchess {
+namespace match {
+
+#ifdef _WIN32
+
+int run(int, char**) {
+  std::fprintf(stderr, "engine match needs a POSIX system\n");
+  return 1;
+}
+
+#else
+
+namespace {
+
+// engines quit after 2.5s without a heartbeat
+constexpr int HEARTBEAT_MS = 200;
+constexpr int PROGRESS_MS = 10000;
+// grace for "quit" before an engine is killed
+constexpr int QUIT_WAIT_MS = 1000;
+const char* const VARIANT_NAMES[3] = { "glinski", "mccooey", "hexofen" };
+
+struct Options {
+  std::vector<std::vector<std::string>> engines;  // argv of each side
+  int games = 1000;
+  int concurrency = 0;  // 0 = hardware
+  int nodes = 0;
+  int movetime_ms = 0;
+  int base_ms = 0, inc_ms = 0;  // --tc, per side
+  int margin_ms = 200;  // over the clock or movetime before a loss on time
+  int variant = -1;  // -1 = all three in turn
+  int opening_plies = 6;
+  int max_plies = 400;
+  double elo0 = 0.0, elo1 = 5.0, alpha = 0.05, beta = 0.05;
+  unsigned seed = 1;
+};
+
+struct Stats {
+  std::atomic<int> next_game{0};
+  std::atomic<bool> stop{false};
+  std::mutex mutex;  // everything below
+  int wins = 0, draws = 0, losses = 0;  // first engine's side
+  int by_variant[3][3] = {};  // [variant][win, draw, loss]
+  int time_losses = 0, illegal_moves = 0, crashes = 0;  // either engine
+};
+
+// a child process with our ends of its stdin and stdout
+struct Engine {
+  pid_t pid = -1;
+  int in = -1, out = -1;
+  std::string buffer;  // read, not yet split into lines
+  std::chrono::steady_clock::time_point last_heartbeat;
+};
+
+// pipes and fork under one lock: a fork from another game must not inherit our pipe ends
+// before they are close-on-exec
+std::mutex g_spawn_mutex;
+
+bool start(Engine& e, const std::vector<std::string>& args) {
+  std::vector<char*> argv;
+  for (const std::string& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+  argv.push_back(nullptr);
+  std::lock_guard<std::mutex> lock(g_spawn_mutex);
+  int to_child[2], from_child[2];
+  if (pipe(to_child) != 0) return false;
+  if (pipe(from_child) != 0) {
+    close(to_child[0]);
+    close(to_child[1]);
+    return false;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    for (int fd : { to_child[0], to_child[1], from_child[0], from_child[1] }) close(fd);
+    return false;
+  }
+  if (pid == 0) {
+    dup2(to_child[0], 0);
+    dup2(from_child[1], 1);
+    for (int fd : { to_child[0], to_child[1], from_child[0], from_child[1] }) close(fd);
+    execvp(argv[0], argv.data());
+    _exit(127);
+  }
+  close(to_child[0]);
+  close(from_child[1]);
+  fcntl(to_child[1], F_SETFD, FD_CLOEXEC);
+  fcntl(from_child[0], F_SETFD, FD_CLOEXEC);
+  e.pid = pid;
+  e.in = to_child[1];
+  e.out = from_child[0];
+  e.last_heartbeat = std::chrono::steady_clock::now();
+  return true;
+}
+
+bool send(Engine& e, const std::string& line) {
+  std::string data = line + "\n";
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t n = write(e.in, data.data() + done, data.size() - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    done += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// quit, then kill if it doesnt exit in time
+void finish(Engine& e) {
+  if (e.pid < 0) return;
+  send(e, "quit");
+  close(e.in);
+  int status = 0;
+  pid_t done = 0;
+  for (int waited = 0; waited < QUIT_WAIT_MS && (done = waitpid(e.pid, &status, WNOHANG)) == 0; waited += 10)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  if (done == 0) {
+    kill(e.pid, SIGKILL);
+    waitpid(e.pid, &status, 0);
+  }
+  close(e.out);
+  e.pid = -1;
+}
+
+enum class Reply { Move, Timeout, Closed, Aborted };
+
+// waits up to limit_ms (< 0 = no limit) for the engine's "Engine Move (...): <move>" line,
+// keeping both engines alive with heartbeats meanwhile. move is the text after the colon
+Reply wait_move(Engine& e, Engine& other, int limit_ms, const std::atomic<bool>& stop, std::string& move) {
+  auto start_time = std::chrono::steady_clock::now();
+  for (;;) {
+    size_t eol;
+    while ((eol = e.buffer.find('\n')) != std::string::npos) {
+      std::string line = e.buffer.substr(0, eol);
+      e.buffer.erase(0, eol + 1);
+      while (!line.empty() && line.back() == '\r') line.pop_back();
+      if (line.rfind("Engine Move (", 0) != 0) continue;
+      auto colon = line.find("): ");
+      if (colon == std::string::npos) continue;
+      move = line.substr(colon + 3);
+      return Reply::Move;
+    }
+    if (stop) return Reply::Aborted;
+    auto now = std::chrono::steady_clock::now();
+    int elapsed = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time).count());
+    if (limit_ms >= 0 && elapsed > limit_ms) return Reply::Timeout;
+    for (Engine* x : { &e, &other }) {
+      if (now - x->last_heartbeat < std::chrono::milliseconds(HEARTBEAT_MS)) continue;
+      send(*x, "heartbeat");
+      x->last_heartbeat = now;
+    }
+    int wait = HEARTBEAT_MS;
+    if (limit_ms >= 0) wait = std::min(wait, limit_ms - elapsed + 1);
+    pollfd pfd{ e.out, POLLIN, 0 };
+    int ready = poll(&pfd, 1, wait);
+    if (ready < 0 && errno != EINTR) return Reply::Closed;
+    if (ready <= 0) continue;
+    char chunk[4096];
+    ssize_t n = read(e.out, chunk, sizeof(chunk));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return Reply::Closed;
+    e.buffer.append(chunk, static_cast<size_t>(n));
+  }
+}
+
+void set_variant(board::State& state, int variant) {
+  if (variant == 1) state.set_mccooey();
+  else if (variant == 2) state.set_hexofen();
+  else state.set_glinski();
+}
+
+// random legal quiet moves from the variant's start position, same for both games of a pair.
+// no captures so neither side starts a piece up
+std::vector<board::Move> opening(const Options& opt, int index, int variant) {
+  std::mt19937_64 rng(opt.seed * 1000003ULL + static_cast<unsigned>(index));
+  board::State state;
+  set_variant(state, variant);
+  std::vector<board::Move> line;
+  for (int ply = 0; ply < opt.opening_plies; ++ply) {
+    bool white = state.white_to_play;
+    std::vector<board::Move> quiet;
+    for (const board::Move& m : moves::generate(state)) {
+      if (m.en_passant || m.promotion || state.at(m.to_col, m.to_row)) continue;
+      board::State::UndoInfo ui = state.make_move(m);
+      if (!attacks::king_attacked(attacks::AttackMap(state), white)) quiet.push_back(m);
+      state.undo_move(m, ui);
+    }
+    if (quiet.empty()) break;
+    line.push_back(quiet[rng() % quiet.size()]);
+    state.make_move(line.back());
+  }
+  return line;
+}
+
+// the move the engine named, if it is one of ours (flags from the generator)
+std::optional<board::Move> resolve(const board::State& state, const std::string& text) {
+  auto parsed = protocol::parse_move(text);
+  if (!parsed) return std::nullopt;
+  for (const board::Move& m : moves::generate(state)) {
+    if (m.from_col == parsed->from_col && m.from_row == parsed->from_row &&
+        m.to_col == parsed->to_col && m.to_row == parsed->to_row)
+      return m;
+  }
+  return std::nullopt;
+}
+
+enum class End { Normal, Time, Illegal, Crash };
+
+// one game, first engine white if first_white. result from white's side; nullopt if aborted
+std::optional<int> play_game(const Options& opt, int variant, const std::vector<board::Move>& line, bool first_white,
+    const std::atomic<bool>& stop, End& end) {
+  end = End::Normal;
+  Engine engines[2];
+  for (int i = 0; i < 2; ++i) {
+    std::vector<std::string> args = opt.engines[static_cast<size_t>(i)];
+    args.push_back("--no-ponder");
+    args.push_back("--no-export");
+    if (!start(engines[i], args)) {
+      for (Engine& e : engines) finish(e);
+      end = End::Crash;
+      return first_white == (i == 0) ? -1 : 1;
+    }
+  }
+  Engine& white_engine = engines[first_white ? 0 : 1];
+  Engine& black_engine = engines[first_white ? 1 : 0];
+
+  board::State state;
+  set_variant(state, variant);
+  std::vector<uint64_t> history;
+  std::string tail;
+  for (const board::Move& m : line) {
+    history.push_back(state.key);
+    state.make_move(m);
+    tail += (tail.empty() ? " moves " : " ") + protocol::format_move(m);
+  }
+
+  int clock[2] = { opt.base_ms, opt.base_ms };  // white, black
+  auto go_line = [&] {
+    if (opt.nodes > 0) return "go nodes " + std::to_string(opt.nodes);
+    if (opt.movetime_ms > 0) return "go movetime " + std::to_string(opt.movetime_ms);
+    return "go wtime " + std::to_string(std::max(clock[0], 1)) + " btime " + std::to_string(std::max(clock[1], 1)) +
+           " winc " + std::to_string(opt.inc_ms) + " binc " + std::to_string(opt.inc_ms);
+  };
+  // limits first: before the board is set, go only stores them
+  send(white_engine, go_line());
+  send(black_engine, go_line());
+  send(white_engine, std::string(VARIANT_NAMES[variant]) + " white" + tail);
+  send(black_engine, std::string(VARIANT_NAMES[variant]) + tail);
+
+  std::optional<int> result;
+  std::string last_move;  // to relay to the side to move
+  for (int ply = static_cast<int>(line.size());; ++ply) {
+    // draws: fifty moves without pawn move or capture, threefold repetition, move cap
+    if (state.halfmove_clock >= 100 || std::count(history.begin(), history.end(), state.key) >= 2 ||
+        ply >= opt.max_plies) {
+      result = 0;
+      break;
+    }
+    bool white = state.white_to_play;
+    Engine& mover = white ? white_engine : black_engine;
+    Engine& waiter = white ? black_engine : white_engine;
+    if (!last_move.empty()) {
+      if (opt.base_ms > 0) send(mover, go_line());
+      send(mover, "move " + last_move);
+    }
+    int limit = opt.base_ms > 0 ? clock[white ? 0 : 1] + opt.margin_ms
+              : opt.movetime_ms > 0 ? opt.movetime_ms + opt.margin_ms : -1;
+    auto t0 = std::chrono::steady_clock::now();
+    std::string text;
+    Reply reply = wait_move(mover, waiter, limit, stop, text);
+    int elapsed = static_cast<int>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count());
+    if (reply == Reply::Aborted) break;
+    if (reply != Reply::Move || (limit >= 0 && elapsed > limit)) {
+      end = reply == Reply::Closed ? End::Crash : End::Time;
+      result = white ? -1 : 1;
+      break;
+    }
+    if (opt.base_ms > 0) clock[white ? 0 : 1] += opt.inc_ms - elapsed;
+    // no move at all: nothing to play, a draw like in selfplay
+    if (text == "(none)") {
+      result = 0;
+      break;
+    }
+    std::optional<board::Move> move = resolve(state, text);
+    if (!move) {
+      end = End::Illegal;
+      result = white ? -1 : 1;
+      break;
+    }
+    history.push_back(state.key);
+    board::State::UndoInfo ui = state.make_move(*move);
+    if (ui.captured && ui.captured->type == 'K') {
+      result = white ? 1 : -1;
+      break;
+    }
+    last_move = text;
+  }
+  for (Engine& e : engines) finish(e);
+  return result;
+}
+
+// score of the first engine per game (win 1, draw 1/2) and its variance
+void score_stats(double w, double d, double l, double& mean, double& var) {
+  double n = w + d + l;
+  mean = (w + 0.5 * d) / n;
+  var = (w * (1.0 - mean) * (1.0 - mean) + d * (0.5 - mean) * (0.5 - mean) + l * mean * mean) / n;
+}
+
+double elo(double score) {
+  score = std::min(std::max(score, 1e-6), 1.0 - 1e-6);
+  return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+double expected_score(double elo_diff) { return 1.0 / (1.0 + std::pow(10.0, -elo_diff / 400.0)); }
+
+// log likelihood ratio of elo1 against elo0, normal approximation of the game scores. half a
+// game of each outcome keeps the variance above 0 when every game so far ended the same way
+double llr(int w, int d, int l, double elo0, double elo1) {
+  if (w + d + l == 0) return 0.0;
+  double mean, var;
+  score_stats(w + 0.5, d + 0.5, l + 0.5, mean, var);
+  if (var <= 0.0) return 0.0;
+  double s0 = expected_score(elo0), s1 = expected_score(elo1);
+  return (w + d + l) * (s1 - s0) * (2.0 * mean - s0 - s1) / (2.0 * var);
+}
+
+void report(Stats& stats, const Options& opt) {
+  std::lock_guard<std::mutex> lock(stats.mutex);
+  int n = stats.wins + stats.draws + stats.losses;
+  double mean = 0.5, var = 0.0;
+  if (n > 0) score_stats(stats.wins, stats.draws, stats.losses, mean, var);
+  double margin = n > 0 ? 1.96 * std::sqrt(var / n) : 0.0;
+  double lo = std::log(opt.beta / (1.0 - opt.alpha)), hi = std::log((1.0 - opt.beta) / opt.alpha);
+  std::printf("games %d/%d +%d =%d -%d elo %.1f +/- %.1f llr %.2f (%.2f, %.2f)\n", n, opt.games, stats.wins,
+      stats.draws, stats.losses, elo(mean), (elo(mean + margin) - elo(mean - margin)) / 2,
+      llr(stats.wins, stats.draws, stats.losses, opt.elo0, opt.elo1), lo, hi);
+  std::fflush(stdout);
+}
+
+// plays games until the count is reached or the sprt decides
+void play_games(const Options& opt, Stats& stats) {
+  double lo = std::log(opt.beta / (1.0 - opt.alpha)), hi = std::log((1.0 - opt.beta) / opt.alpha);
+  while (!stats.stop) {
+    int game = stats.next_game.fetch_add(1);
+    if (game >= opt.games) break;
+    int pair = game / 2;
+    int variant = opt.variant >= 0 ? opt.variant : pair % 3;
+    bool first_white = game % 2 == 0;
+    End end;
+    std::optional<int> result = play_game(opt, variant, opening(opt, pair, variant), first_white, stats.stop, end);
+    if (!result) break;
+    int score = first_white ? *result : -*result;
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    if (stats.stop) break;
+    (score > 0 ? stats.wins : score < 0 ? stats.losses : stats.draws)++;
+    stats.by_variant[variant][score > 0 ? 0 : score < 0 ? 2 : 1]++;
+    if (end == End::Time) stats.time_losses++;
+    else if (end == End::Illegal) stats.illegal_moves++;
+    else if (end == End::Crash) stats.crashes++;
+    double ratio = llr(stats.wins, stats.draws, stats.losses, opt.elo0, opt.elo1);
+    if (ratio <= lo || ratio >= hi) stats.stop = true;
+  }
+}
+
+std::vector<std::string> split_command(const std::string& cmd) {
+  std::istringstream iss(cmd);
+  std::vector<std::string> args;
+  for (std::string tok; iss >> tok;) args.push_back(tok);
+  return args;
+}
+
+int usage() {
+  std::fprintf(stderr,
+      "usage: engine match --engine <cmd> --engine <cmd> [--games N] [--concurrency N]\n"
+      "  [--nodes N | --movetime MS | --tc S+S] [--margin MS] [--variant glinski|mccooey|hexofen|all]\n"
+      "  [--opening-plies N] [--max-plies N] [--elo0 X] [--elo1 X] [--alpha X] [--beta X] [--seed N]\n");
+  return 2;
+}
+
+}  // namespace
+
+int run(int argc, char** argv) {
+  Options opt;
+  for (int i = 0; i + 1 < argc; i += 2) {
+    std::string arg = argv[i], val = argv[i + 1];
+    if (arg == "--engine") opt.engines.push_back(split_command(val));
+    else if (arg == "--games") opt.games = std::atoi(val.c_str());
+    else if (arg == "--concurrency") opt.concurrency = std::atoi(val.c_str());
+    else if (arg == "--nodes") opt.nodes = std::atoi(val.c_str());
+    else if (arg == "--movetime") opt.movetime_ms = std::atoi(val.c_str());
+    else if (arg == "--tc") {
+      // seconds, "60+0.5"
+      auto plus = val.find('+');
+      opt.base_ms = static_cast<int>(std::atof(val.substr(0, plus).c_str()) * 1000);
+      if (plus != std::string::npos) opt.inc_ms = static_cast<int>(std::atof(val.c_str() + plus + 1) * 1000);
+    } else if (arg == "--margin") opt.margin_ms = std::atoi(val.c_str());
+    else if (arg == "--opening-plies") opt.opening_plies = std::atoi(val.c_str());
+    else if (arg == "--max-plies") opt.max_plies = std::atoi(val.c_str());
+    else if (arg == "--elo0") opt.elo0 = std::atof(val.c_str());
+    else if (arg == "--elo1") opt.elo1 = std::atof(val.c_str());
+    else if (arg == "--alpha") opt.alpha = std::atof(val.c_str());
+    else if (arg == "--beta") opt.beta = std::atof(val.c_str());
+    else if (arg == "--seed") opt.seed = static_cast<unsigned>(std::atoi(val.c_str()));
+    else if (arg == "--variant") {
+      if (val == "glinski") opt.variant = 0;
+      else if (val == "mccooey") opt.variant = 1;
+      else if (val == "hexofen") opt.variant = 2;
+      else if (val == "all") opt.variant = -1;
+      else return usage();
+    } else {
+      return usage();
+    }
+  }
+  int limits = (opt.nodes > 0) + (opt.movetime_ms > 0) + (opt.base_ms > 0);
+  if (argc % 2 != 0 || opt.engines.size() != 2 || opt.engines[0].empty() || opt.engines[1].empty() ||
+      opt.games <= 0 || limits != 1 || opt.alpha <= 0 || opt.beta <= 0 || opt.elo1 <= opt.elo0)
+    return usage();
+  int concurrency = opt.concurrency > 0 ? opt.concurrency : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  // a dead engine shows up as a closed pipe, not a signal
+  std::signal(SIGPIPE, SIG_IGN);
+
+  Stats stats;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < concurrency; ++t) workers.emplace_back(play_games, std::cref(opt), std::ref(stats));
+  auto start = std::chrono::steady_clock::now();
+  auto last = start;
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(stats.mutex);
+      if (stats.stop || stats.wins + stats.draws + stats.losses >= opt.games) break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto now = std::chrono::steady_clock::now();
+    if (now - last >= std::chrono::milliseconds(PROGRESS_MS)) {
+      last = now;
+      report(stats, opt);
+    }
+  }
+  for (auto& w : workers) w.join();
+  report(stats, opt);
+  for (int v = 0; v < 3; ++v) {
+    const int* r = stats.by_variant[v];
+    if (r[0] + r[1] + r[2] > 0) std::printf("%s +%d =%d -%d\n", VARIANT_NAMES[v], r[0], r[1], r[2]);
+  }
+  if (stats.time_losses + stats.illegal_moves + stats.crashes > 0)
+    std::printf("losses on time %d, illegal moves %d, crashes %d\n", stats.time_losses, stats.illegal_moves,
+        stats.crashes);
+  double ratio = llr(stats.wins, stats.draws, stats.losses, opt.elo0, opt.elo1);
+  double lo = std::log(opt.beta / (1.0 - opt.alpha)), hi = std::log((1.0 - opt.beta) / opt.alpha);
+  std::printf("sprt elo0 %.1f elo1 %.1f: %s\n", opt.elo0, opt.elo1,
+      ratio >= hi ? "H1 accepted" : ratio <= lo ? "H0 accepted" : "no decision");
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::printf("%.0fs\n", secs);
+  return 0;
+}
+
+#endif
+
+}  // namespace match
+}  // namespace hexchess
@@ -0,0 +1,16 @@
+#pragma once
+
+namespace hexchess {
+namespace match {
+
+// two engine binaries or configurations against each other over the stdin/stdout protocol,
+// several games at once, until --games or an sprt decision:
+// engine match --engine <cmd> --engine <cmd> [--games N] [--concurrency N]
+//   [--nodes N | --movetime MS | --tc S+S] [--margin MS] [--variant glinski|mccooey|hexofen|all]
+//   [--opening-plies N] [--max-plies N] [--elo0 X] [--elo1 X] [--alpha X] [--beta X] [--seed N]
+// each opening is played twice with colours swapped. results are from the first engine's side.
+// args without "engine match". returns the exit code
+int run(int argc, char** argv);
+
+}  // namespace match
+}  // namespace hexchess
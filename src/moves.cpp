@@ -1,6 +1,7 @@
 #include "moves.hpp"
 #include "board.hpp"
 #include "eval.hpp"
+#include "attacks.hpp"
 #include <algorithm>
 #include <cmath>
 
@@ -9,31 +10,6 @@ namespace moves {
 
 using namespace board;
 
-// (col_delta, logical_row_delta)
-struct Dir { int dc, dr; };
-
-// Horizontal (rook) directions - 6.
-static const Dir HORIZ[] = {
-  { 0, 1 }, { 0, -1 }, { -1, 0 }, { 1, 0 }, { 1, 1 }, { -1, -1 }
-};
-// Diagonal (bishop) directions - 6.
-static const Dir DIAG[] = {
-  { -2, -1 }, { 2, 1 }, { 1, 2 }, { -1, 1 }, { 1, -1 }, { -1, -2 }
-};
-// Knight jumps - 12.
-static const Dir KNIGHT[] = {
-  { 1, 3 }, { 2, 3 }, { 3, 1 }, { 3, 2 }, { 2, -1 }, { 1, -2 },
-  { -1, -3 }, { -2, -3 }, { -3, -1 }, { -3, -2 }, { -2, 1 }, { -1, 2 }
-};
-// King - 12 (horizontal + diagonal).
-static const Dir KING[] = {
-  { 0, 1 }, { 0, -1 }, { -1, 0 }, { 1, 0 }, { 1, 1 }, { -1, -1 },
-  { -2, -1 }, { 2, 1 }, { 1, 2 }, { -1, 1 }, { 1, -1 }, { -1, -2 }
-};
-// White pawn capture directions (col, logical_row).
-static const Dir W_PAWN_CAP[] = { { -1, 0 }, { 1, 1 } };
-static const Dir B_PAWN_CAP[] = { { -1, -1 }, { 1, 0 } };
-
 static bool is_starting_pawn_white_glinski(int col, int storage_row) {
   if (col < 6) return (col - 1) == storage_row;
   return (storage_row + col) == 9;
@@ -74,76 +50,32 @@ bool is_starting_pawn_black(const State& state, int col, int storage_row) {
   return false;
 }
 
-// ep target square if any (pawns double-step only)
-static std::string en_passant_square(const State& state) {
-  if (!state.prev_move) return "";
+// ep target cell if any (pawns double-step only), else -1
+static int en_passant_cell(const State& state) {
+  if (!state.prev_move) return -1;
   const Move& pm = *state.prev_move;
-  if (std::abs(pm.to_row - pm.from_row) != 2) return "";
-  int ep_col = pm.to_col;
+  if (std::abs(pm.to_row - pm.from_row) != 2) return -1;
   bool moved_white = !state.white_to_play;
   int ep_row = moved_white ? pm.to_row - 1 : pm.to_row + 1;
-  return square_notation(ep_col, ep_row);
-}
-
-static void add_displacement_moves(std::vector<Move>& out, const State& state,
-    int col, int row, bool piece_white, char piece_type, const Dir* dirs, int n) {
-  int logical = get_logical_row(col, row);
-  for (int i = 0; i < n; ++i) {
-    int nc = col + dirs[i].dc;
-    int nlog = logical + dirs[i].dr;
-    int nr = get_storage_row(nc, nlog);
-    if (!state.on_board(nc, nr)) continue;
-    std::optional<Piece> target = state.at(nc, nr);
-    if (!target) {
-      out.push_back(Move{ col, row, nc, nr, false, false, false });
-    } else if (target->white != piece_white) {
-      out.push_back(Move{ col, row, nc, nr, true, false, false });
-    }
-  }
-}
-
-static void add_straight_moves(std::vector<Move>& out, const State& state,
-    int col, int row, bool piece_white, const Dir* dirs, int n) {
-  int logical = get_logical_row(col, row);
-  for (int i = 0; i < n; ++i) {
-    int dc = dirs[i].dc, dr = dirs[i].dr;
-    int c = col, lr = logical;
-    for (;;) {
-      c += dc; lr += dr;
-      int sr = get_storage_row(c, lr);
-      if (!state.on_board(c, sr)) break;
-      std::optional<Piece> target = state.at(c, sr);
-      if (!target) {
-        out.push_back(Move{ col, row, c, sr, false, false, false });
-      } else {
-        if (target->white != piece_white)
-          out.push_back(Move{ col, row, c, sr, true, false, false });
-        break;
-      }
-    }
-  }
+  return attacks::cell(pm.to_col, ep_row);
 }
 
 static void add_pawn_moves(std::vector<Move>& out, const State& state,
-    int col, int row, bool piece_white) {
-  int logical = get_logical_row(col, row);
-  const Dir* cap_dirs = piece_white ? W_PAWN_CAP : B_PAWN_CAP;
-  std::string ep_square = en_passant_square(state);
-
-  for (int i = 0; i < 2; ++i) {
-    int nc = col + cap_dirs[i].dc;
-    int nlog = logical + cap_dirs[i].dr;
-    int nr = get_storage_row(nc, nlog);
-    if (!state.on_board(nc, nr)) continue;
-    if (square_notation(nc, nr) == ep_square) {
+    const attacks::PieceAttacks& pa, bool piece_white, int ep_cell) {
+  int col = attacks::cell_col(pa.from), row = attacks::cell_row(pa.from);
+  for (int i = 0; i < pa.num_targets; ++i) {
+    int to = pa.targets[static_cast<size_t>(i)];
+    int nc = attacks::cell_col(to), nr = attacks::cell_row(to);
+    if (to == ep_cell) {
       out.push_back(Move{ col, row, nc, nr, true, true, false });
       continue;
     }
-    std::optional<Piece> target = state.at(nc, nr);
+    const Square& target = state.cells[static_cast<size_t>(nc)][static_cast<size_t>(nr)];
     if (target && target->white != piece_white)
       out.push_back(Move{ col, row, nc, nr, true, false, false });
   }
 
+  int logical = get_logical_row(col, row);
   int forward_lr = piece_white ? logical + 1 : logical - 1;
   int forward_sr = get_storage_row(col, forward_lr);
   if (!state.on_board(col, forward_sr)) return;
@@ -160,7 +92,7 @@ static void add_pawn_moves(std::vector<Move>& out, const State& state,
 }
 
 // black promo row 0; white last rank (row-col==5 or col+row==15)
-static bool is_promotion(const State& state, int to_col, int to_row, bool piece_white) {
+bool is_promotion(const State& state, int to_col, int to_row, bool piece_white) {
   if (piece_white) {
     if (to_col <= 5 && (to_row - to_col) == 5) return true;
     if (to_col > 5 && (to_col + to_row) == 15) return true;
@@ -171,40 +103,32 @@ static bool is_promotion(const State& state, int to_col, int to_row, bool piece_
 }
 
 std::vector<Move> generate(const State& state) {
+  attacks::AttackMap map(state);
+  return generate(state, map);
+}
+
+std::vector<Move> generate(const State& state, const attacks::AttackMap& map) {
   std::vector<Move> result;
   bool white_to_move = state.white_to_play;
-
-  for (int c = 0; c < NUM_COLS; ++c) {
-    int maxr = max_row(state.variant, c);
-    for (int r = 0; r < maxr; ++r) {
-      std::optional<Piece> sq = state.at(c, r);
-      if (!sq || sq->white != white_to_move) continue;
-      char t = sq->type;
-      bool pw = sq->white;
-
-      switch (t) {
-        case 'P':
-          add_pawn_moves(result, state, c, r, pw);
-          break;
-        case 'R':
-          add_straight_moves(result, state, c, r, pw, HORIZ, 6);
-          break;
-        case 'N':
-          add_displacement_moves(result, state, c, r, pw, t, KNIGHT, 12);
-          break;
-        case 'B':
-          add_straight_moves(result, state, c, r, pw, DIAG, 6);
-          break;
-        case 'K':
-          add_displacement_moves(result, state, c, r, pw, t, KING, 12);
-          break;
-        case 'Q':
-          add_straight_moves(result, state, c, r, pw, HORIZ, 6);
-          add_straight_moves(result, state, c, r, pw, DIAG, 6);
-          break;
-        default:
-          break;
-      }
+  const attacks::SideAttacks& own = map.side(white_to_move);
+  int ep_cell = en_passant_cell(state);
+
+  // attacked cells that are empty or hold an enemy piece. pawns only move there by capturing
+  for (int p = 0; p < own.num_pieces; ++p) {
+    const attacks::PieceAttacks& pa = own.pieces[static_cast<size_t>(p)];
+    if (pa.type == 'P') {
+      add_pawn_moves(result, state, pa, white_to_move, ep_cell);
+      continue;
+    }
+    int col = attacks::cell_col(pa.from), row = attacks::cell_row(pa.from);
+    for (int i = 0; i < pa.num_targets; ++i) {
+      int to = pa.targets[static_cast<size_t>(i)];
+      int nc = attacks::cell_col(to), nr = attacks::cell_row(to);
+      const Square& target = state.cells[static_cast<size_t>(nc)][static_cast<size_t>(nr)];
+      if (!target)
+        result.push_back(Move{ col, row, nc, nr, false, false, false });
+      else if (target->white != white_to_move)
+        result.push_back(Move{ col, row, nc, nr, true, false, false });
     }
   }
 
@@ -231,7 +155,8 @@ static int mvv_lva_score(const State& state, const Move& m) {
 }
 
 void order_moves(std::vector<Move>& moves, const State& state,
-    std::optional<Move> hash_move, std::optional<Move> killer1, std::optional<Move> killer2) {
+    std::optional<Move> hash_move, std::optional<Move> killer1, std::optional<Move> killer2,
+    const History* history, const attacks::AttackMap* map) {
   std::vector<Move> ordered;
   ordered.reserve(moves.size());
 
@@ -252,22 +177,34 @@ void order_moves(std::vector<Move>& moves, const State& state,
     }
   }
 
-  std::vector<Move> captures, killers, rest;
+  std::vector<Move> captures, bad_captures, killers, rest;
   for (const Move& m : moves) {
     if (m.capture || m.en_passant) {
-      captures.push_back(m);
+      if (map && attacks::see(*map, m) < 0) bad_captures.push_back(m);
+      else captures.push_back(m);
     } else if (is_killer(m)) {
       killers.push_back(m);
     } else {
       rest.push_back(m);
     }
   }
-  std::sort(captures.begin(), captures.end(), [&](const Move& a, const Move& b) {
+  auto by_mvv_lva = [&](const Move& a, const Move& b) {
     return mvv_lva_score(state, a) > mvv_lva_score(state, b);
-  });
+  };
+  std::sort(captures.begin(), captures.end(), by_mvv_lva);
+  std::sort(bad_captures.begin(), bad_captures.end(), by_mvv_lva);
+
+  if (history) {
+    const History& h = *history;
+    bool white = state.white_to_play;
+    std::stable_sort(rest.begin(), rest.end(), [&](const Move& a, const Move& b) {
+      return history_entry(h, white, a) > history_entry(h, white, b);
+    });
+  }
 
   for (const Move& m : captures) ordered.push_back(m);
   for (const Move& m : killers) ordered.push_back(m);
+  for (const Move& m : bad_captures) ordered.push_back(m);
   for (const Move& m : rest) ordered.push_back(m);
 
   moves = std::move(ordered);
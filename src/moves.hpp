@@ -1,6 +1,8 @@
 #pragma once
 
 #include "board.hpp"
+#include "attacks.hpp"
+#include <array>
 #include <optional>
 #include <vector>
 
@@ -9,15 +11,32 @@ namespace moves {
 
 // all legal moves for side to move
 std::vector<board::Move> generate(const board::State& state);
+// same, reading piece targets from the node's attack map
+std::vector<board::Move> generate(const board::State& state, const attacks::AttackMap& map);
 
-// hash first, then captures (mvv-lva), killers, rest
+// quiet move history [side][from cell][to cell], cell = col * 11 + storage row. higher = try earlier
+constexpr int HISTORY_CELLS = board::NUM_COLS * 11;
+using History = std::array<std::array<std::array<int, HISTORY_CELLS>, HISTORY_CELLS>, 2>;
+
+inline int& history_entry(History& h, bool white, const board::Move& m) {
+  return h[white ? 0 : 1][static_cast<size_t>(m.from_col * 11 + m.from_row)][static_cast<size_t>(m.to_col * 11 + m.to_row)];
+}
+inline int history_entry(const History& h, bool white, const board::Move& m) {
+  return h[white ? 0 : 1][static_cast<size_t>(m.from_col * 11 + m.from_row)][static_cast<size_t>(m.to_col * 11 + m.to_row)];
+}
+
+// hash first, then captures (mvv-lva), killers, rest (by history if given).
+// with a map, captures that lose material (see < 0) go after the killers
 void order_moves(std::vector<board::Move>& moves, const board::State& state,
     std::optional<board::Move> hash_move,
-    std::optional<board::Move> killer1, std::optional<board::Move> killer2);
+    std::optional<board::Move> killer1, std::optional<board::Move> killer2,
+    const History* history = nullptr, const attacks::AttackMap* map = nullptr);
 
 // white/black pawn start square for variant
 bool is_starting_pawn_white(const board::State& state, int col, int storage_row);
 bool is_starting_pawn_black(const board::State& state, int col, int storage_row);
+// a pawn of that colour moving to the cell promotes
+bool is_promotion(const board::State& state, int to_col, int to_row, bool piece_white);
 
 }  // namespace moves
 }  // namespace hexchess
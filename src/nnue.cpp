@@ -0,0 +1,311 @@
+#include "nnue.hpp"
+#include "board.hpp"
+#include "eval.hpp"
+#include <algorithm>
+#include <fstream>
+#include <memory>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HEXCHESS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace hexchess {
+namespace nnue {
+
+static constexpr uint32_t NETWORK_VERSION = 1;
+
+static std::array<std::unique_ptr<Network>, 3> g_nets;
+
+// ---- kernels. picked once per process from what the cpu supports ----
+
+// acc += row (sign 1) or acc -= row
+static void acc_update_scalar(int16_t* acc, const int16_t* row, int sign) {
+  if (sign > 0)
+    for (int i = 0; i < HIDDEN; ++i) acc[i] = static_cast<int16_t>(acc[i] + row[i]);
+  else
+    for (int i = 0; i < HIDDEN; ++i) acc[i] = static_cast<int16_t>(acc[i] - row[i]);
+}
+
+// out[o] = bias[o] + sum in[i] * w[o * n_in + i]. n_in a multiple of 32
+static void affine_scalar(const uint8_t* in, int n_in, const int8_t* w, const int32_t* bias,
+    int32_t* out, int n_out) {
+  for (int o = 0; o < n_out; ++o) {
+    int32_t sum = bias[o];
+    const int8_t* row = w + o * n_in;
+    for (int i = 0; i < n_in; ++i) sum += in[i] * row[i];
+    out[o] = sum;
+  }
+}
+
+#ifdef HEXCHESS_X86_SIMD
+__attribute__((target("avx2")))
+static void acc_update_avx2(int16_t* acc, const int16_t* row, int sign) {
+  for (int i = 0; i < HIDDEN; i += 16) {
+    __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(acc + i));
+    __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+    a = sign > 0 ? _mm256_add_epi16(a, r) : _mm256_sub_epi16(a, r);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(acc + i), a);
+  }
+}
+
+// u8 x i8 pairs to i16 (inputs <= 127, so no saturation), then pairs of those to i32
+__attribute__((target("avx2")))
+static void affine_avx2(const uint8_t* in, int n_in, const int8_t* w, const int32_t* bias,
+    int32_t* out, int n_out) {
+  const __m256i ones = _mm256_set1_epi16(1);
+  for (int o = 0; o < n_out; ++o) {
+    const int8_t* row = w + o * n_in;
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < n_in; i += 32) {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+      sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(a, b), ones));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_hadd_epi32(s, s);
+    s = _mm_hadd_epi32(s, s);
+    out[o] = bias[o] + _mm_cvtsi128_si32(s);
+  }
+}
+
+__attribute__((target("sse4.1")))
+static void acc_update_sse41(int16_t* acc, const int16_t* row, int sign) {
+  for (int i = 0; i < HIDDEN; i += 8) {
+    __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(acc + i));
+    __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+    a = sign > 0 ? _mm_add_epi16(a, r) : _mm_sub_epi16(a, r);
+    _mm_store_si128(reinterpret_cast<__m128i*>(acc + i), a);
+  }
+}
+
+__attribute__((target("sse4.1")))
+static void affine_sse41(const uint8_t* in, int n_in, const int8_t* w, const int32_t* bias,
+    int32_t* out, int n_out) {
+  const __m128i ones = _mm_set1_epi16(1);
+  for (int o = 0; o < n_out; ++o) {
+    const int8_t* row = w + o * n_in;
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < n_in; i += 16) {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+      sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(a, b), ones));
+    }
+    sum = _mm_hadd_epi32(sum, sum);
+    sum = _mm_hadd_epi32(sum, sum);
+    out[o] = bias[o] + _mm_cvtsi128_si32(sum);
+  }
+}
+#endif
+
+struct Kernels {
+  void (*acc_update)(int16_t*, const int16_t*, int);
+  void (*affine)(const uint8_t*, int, const int8_t*, const int32_t*, int32_t*, int);
+  const char* name;
+};
+
+static Kernels pick_kernels() {
+#ifdef HEXCHESS_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return { acc_update_avx2, affine_avx2, "avx2" };
+  if (__builtin_cpu_supports("sse4.1")) return { acc_update_sse41, affine_sse41, "sse4.1" };
+#endif
+  return { acc_update_scalar, affine_scalar, "scalar" };
+}
+
+static const Kernels& kernels() {
+  static const Kernels k = pick_kernels();
+  return k;
+}
+
+const char* simd_name() {
+  return kernels().name;
+}
+
+// ---- features ----
+
+static int cell_offset(int col) {
+  static const std::array<int, board::NUM_COLS + 1> offsets = [] {
+    std::array<int, board::NUM_COLS + 1> o{};
+    for (int c = 0; c < board::NUM_COLS; ++c) o[static_cast<size_t>(c + 1)] = o[static_cast<size_t>(c)] + board::max_row_glinski(c);
+    return o;
+  }();
+  return offsets[static_cast<size_t>(col)];
+}
+
+int oriented_cell(int perspective, int col, int storage_row) {
+  int row = perspective == 0 ? storage_row : board::max_row_glinski(col) - 1 - storage_row;
+  return cell_offset(col) + row;
+}
+
+static int piece_slot(char type) {
+  switch (type) {
+    case 'P': return 0; case 'R': return 1; case 'N': return 2;
+    case 'B': return 3; case 'Q': return 4; case 'K': return 5;
+    default: return 0;
+  }
+}
+
+int feature(int perspective, int king_cell, const board::Piece& p, int col, int storage_row) {
+  bool own = p.white == (perspective == 0);
+  if (own && p.type == 'K') return -1;
+  int slot = own ? piece_slot(p.type) : 5 + piece_slot(p.type);
+  return (king_cell * PIECE_SLOTS + slot) * CELLS + oriented_cell(perspective, col, storage_row);
+}
+
+// ---- accumulator ----
+
+bool active(board::Variant variant) {
+  return g_nets[static_cast<size_t>(variant)] != nullptr;
+}
+
+void refresh(board::State& state, int perspective) {
+  const Network* net = g_nets[static_cast<size_t>(state.variant)].get();
+  if (!net) return;
+  Accumulator& acc = state.nnue;
+  size_t s = static_cast<size_t>(perspective);
+  acc.king[s] = -1;
+  for (int c = 0; c < board::NUM_COLS; ++c)
+    for (int r = 0; r < board::max_row(state.variant, c); ++r) {
+      const board::Square& sq = state.cells[static_cast<size_t>(c)][static_cast<size_t>(r)];
+      if (sq && sq->type == 'K' && sq->white == (perspective == 0))
+        acc.king[s] = static_cast<int8_t>(oriented_cell(perspective, c, r));
+    }
+  if (acc.king[s] < 0) return;
+  std::copy(net->ft_bias.begin(), net->ft_bias.end(), acc.values[s].begin());
+  const Kernels& k = kernels();
+  for (int c = 0; c < board::NUM_COLS; ++c)
+    for (int r = 0; r < board::max_row(state.variant, c); ++r) {
+      const board::Square& sq = state.cells[static_cast<size_t>(c)][static_cast<size_t>(r)];
+      if (!sq) continue;
+      int f = feature(perspective, acc.king[s], *sq, c, r);
+      if (f >= 0) k.acc_update(acc.values[s].data(), &net->ft_weights[static_cast<size_t>(f) * HIDDEN], 1);
+    }
+}
+
+void refresh(board::State& state) {
+  refresh(state, 0);
+  refresh(state, 1);
+}
+
+void update(board::State& state, int col, int storage_row, const board::Piece& p, int sign) {
+  const Network* net = g_nets[static_cast<size_t>(state.variant)].get();
+  if (!net) return;
+  Accumulator& acc = state.nnue;
+  for (int s = 0; s < 2; ++s) {
+    // own king moved: every feature of that half changes
+    if (p.type == 'K' && p.white == (s == 0)) {
+      if (sign > 0)
+        refresh(state, s);
+      else
+        acc.king[static_cast<size_t>(s)] = -1;
+      continue;
+    }
+    int king = acc.king[static_cast<size_t>(s)];
+    if (king < 0) continue;
+    int f = feature(s, king, p, col, storage_row);
+    kernels().acc_update(acc.values[static_cast<size_t>(s)].data(), &net->ft_weights[static_cast<size_t>(f) * HIDDEN], sign);
+  }
+}
+
+// ---- inference ----
+
+int evaluate(const board::State& state) {
+  const Network& net = *g_nets[static_cast<size_t>(state.variant)];
+  const Kernels& k = kernels();
+  size_t stm = state.white_to_play ? 0 : 1;
+  alignas(32) std::array<uint8_t, 2 * HIDDEN> input;
+  for (int i = 0; i < HIDDEN; ++i) {
+    input[static_cast<size_t>(i)] = static_cast<uint8_t>(std::clamp<int>(state.nnue.values[stm][static_cast<size_t>(i)], 0, QA));
+    input[static_cast<size_t>(HIDDEN + i)] = static_cast<uint8_t>(std::clamp<int>(state.nnue.values[1 - stm][static_cast<size_t>(i)], 0, QA));
+  }
+  alignas(32) std::array<int32_t, L2> hidden;
+  k.affine(input.data(), 2 * HIDDEN, net.l2_weights.data(), net.l2_bias.data(), hidden.data(), L2);
+  alignas(32) std::array<uint8_t, L2> hidden8;
+  for (int i = 0; i < L2; ++i)
+    hidden8[static_cast<size_t>(i)] = static_cast<uint8_t>(std::clamp(hidden[static_cast<size_t>(i)] / QB, 0, QA));
+  int32_t out = 0;
+  k.affine(hidden8.data(), L2, net.out_weights.data(), &net.out_bias, &out, 1);
+  int cp = static_cast<int>(static_cast<int64_t>(out) * net.output_scale / (QA * QB));
+  return stm == 0 ? cp : -cp;
+}
+
+// ---- file ----
+
+static void put_u32(std::string& out, uint32_t v) {
+  for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static constexpr size_t NETWORK_HEADER = 28;
+static constexpr size_t NETWORK_BYTES = NETWORK_HEADER + HIDDEN * 2 + static_cast<size_t>(INPUTS) * HIDDEN * 2 +
+    L2 * 4 + L2 * 2 * HIDDEN + 4 + L2;
+
+bool load_network(const std::string& path) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f) return false;
+  std::string data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+  const auto* p = reinterpret_cast<const unsigned char*>(data.data());
+  if (data.size() != NETWORK_BYTES) return false;
+  if (data.compare(0, 4, "HXNN") != 0 || get_u32(p + 4) != NETWORK_VERSION || get_u32(p + 8) > 2 ||
+      get_u32(p + 12) != static_cast<uint32_t>(INPUTS) || get_u32(p + 16) != static_cast<uint32_t>(HIDDEN) ||
+      get_u32(p + 20) != static_cast<uint32_t>(L2))
+    return false;
+  auto net = std::make_unique<Network>();
+  net->variant = static_cast<int>(get_u32(p + 8));
+  net->output_scale = static_cast<int32_t>(get_u32(p + 24));
+  p += NETWORK_HEADER;
+  auto i16 = [&](std::vector<int16_t>& v, size_t n) {
+    v.resize(n);
+    for (auto& x : v) { x = static_cast<int16_t>(p[0] | (p[1] << 8)); p += 2; }
+  };
+  auto i8 = [&](std::vector<int8_t>& v, size_t n) {
+    v.resize(n);
+    for (auto& x : v) x = static_cast<int8_t>(*p++);
+  };
+  i16(net->ft_bias, HIDDEN);
+  i16(net->ft_weights, static_cast<size_t>(INPUTS) * HIDDEN);
+  net->l2_bias.resize(L2);
+  for (auto& x : net->l2_bias) { x = static_cast<int32_t>(get_u32(p)); p += 4; }
+  i8(net->l2_weights, L2 * 2 * HIDDEN);
+  net->out_bias = static_cast<int32_t>(get_u32(p));
+  p += 4;
+  i8(net->out_weights, L2);
+  g_nets[static_cast<size_t>(net->variant)] = std::move(net);
+  eval::clear_cache();
+  return true;
+}
+
+bool save_network(const std::string& path, const Network& net) {
+  if (net.ft_bias.size() != HIDDEN || net.ft_weights.size() != static_cast<size_t>(INPUTS) * HIDDEN ||
+      net.l2_bias.size() != L2 || net.l2_weights.size() != L2 * 2 * HIDDEN || net.out_weights.size() != L2)
+    return false;
+  std::string out = "HXNN";
+  out.reserve(NETWORK_BYTES);
+  for (uint32_t v : { NETWORK_VERSION, static_cast<uint32_t>(net.variant), static_cast<uint32_t>(INPUTS),
+           static_cast<uint32_t>(HIDDEN), static_cast<uint32_t>(L2), static_cast<uint32_t>(net.output_scale) })
+    put_u32(out, v);
+  auto i16 = [&](const std::vector<int16_t>& v) {
+    for (int16_t x : v) {
+      out.push_back(static_cast<char>(static_cast<uint16_t>(x) & 0xFF));
+      out.push_back(static_cast<char>(static_cast<uint16_t>(x) >> 8));
+    }
+  };
+  i16(net.ft_bias);
+  i16(net.ft_weights);
+  for (int32_t x : net.l2_bias) put_u32(out, static_cast<uint32_t>(x));
+  for (int8_t x : net.l2_weights) out.push_back(static_cast<char>(x));
+  put_u32(out, static_cast<uint32_t>(net.out_bias));
+  for (int8_t x : net.out_weights) out.push_back(static_cast<char>(x));
+  std::ofstream f(path, std::ios::binary);
+  if (!f) return false;
+  f.write(out.data(), static_cast<std::streamsize>(out.size()));
+  return static_cast<bool>(f);
+}
+
+}  // namespace nnue
+}  // namespace hexchess
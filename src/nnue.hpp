@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hexchess {
+namespace board {
+struct State;
+struct Piece;
+enum class Variant;
+}
+
+namespace nnue {
+
+// halfkp-style input: (own king cell, piece, cell) per perspective, both seen from that
+// side (black reads columns mirrored). pieces: own P R N B Q, their P R N B Q K
+static constexpr int CELLS = 91;
+static constexpr int PIECE_SLOTS = 11;
+static constexpr int INPUTS = CELLS * PIECE_SLOTS * CELLS;
+static constexpr int HIDDEN = 128;  // accumulator width per perspective
+static constexpr int L2 = 32;
+
+// quantization: accumulator 1.0 = QA, dense weights 1.0 = QB
+static constexpr int QA = 127;
+static constexpr int QB = 64;
+
+// first layer sums, one half per perspective (0 = white). kept in board::State
+struct Accumulator {
+  alignas(32) std::array<std::array<int16_t, HIDDEN>, 2> values;
+  std::array<int8_t, 2> king{ { -1, -1 } };  // oriented king cell, -1 = no king (not tracked)
+};
+
+// quantized weights, file order
+struct Network {
+  int variant = 0;
+  int output_scale = 400;  // centipawns per 1.0 of output
+  std::vector<int16_t> ft_bias;  // HIDDEN
+  std::vector<int16_t> ft_weights;  // INPUTS x HIDDEN
+  std::vector<int32_t> l2_bias;  // L2
+  std::vector<int8_t> l2_weights;  // L2 x 2*HIDDEN (side to move half first)
+  int32_t out_bias = 0;
+  std::vector<int8_t> out_weights;  // L2
+};
+
+// "HXNN", u32 version, u32 variant, u32 inputs, u32 hidden, u32 l2, i32 output_scale, then
+// the Network fields in order, little-endian. one net per variant; positions of a variant
+// without a net keep the classical eval. load before building states (or refresh them)
+bool load_network(const std::string& path);
+bool save_network(const std::string& path, const Network& net);
+bool active(board::Variant variant);
+
+// feature index for perspective (0 = white), -1 if p is that side's own king
+int feature(int perspective, int king_cell, const board::Piece& p, int col, int storage_row);
+// compact 0..90 cell, mirrored for black
+int oriented_cell(int perspective, int col, int storage_row);
+
+// accumulator upkeep, called by State. update: piece on (sign 1) or off (-1) a cell with
+// cells already showing the change for an own king going on
+void refresh(board::State& state);
+void refresh(board::State& state, int perspective);
+void update(board::State& state, int col, int storage_row, const board::Piece& p, int sign);
+
+// white POV centipawns. state must have a net and both kings
+int evaluate(const board::State& state);
+
+// "avx2", "sse4.1" or "scalar": kernels picked for this cpu
+const char* simd_name();
+
+}  // namespace nnue
+}  // namespace hexchess
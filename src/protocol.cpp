@@ -1,6 +1,9 @@
 #include "protocol.hpp"
 #include "board.hpp"
+#include <algorithm>
 #include <cctype>
+#include <cstdlib>
+#include <limits>
 #include <optional>
 #include <sstream>
 #include <string>
@@ -46,9 +49,167 @@ std::optional<board::State> parse_board(const std::vector<std::string>& lines) {
   else if (side == "black") state.white_to_play = false;
   else return std::nullopt;
   state.prev_move = std::nullopt;
+  state.refresh();
   return state;
 }
 
+static const char* const VARIANT_NAMES[3] = { "glinski", "mccooey", "hexofen" };
+
+static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+// next whitespace-separated token at or after pos, pos moves past it
+static std::string_view next_token(std::string_view text, size_t& pos) {
+  while (pos < text.size() && is_space(text[pos])) ++pos;
+  size_t start = pos;
+  while (pos < text.size() && !is_space(text[pos])) ++pos;
+  return text.substr(start, pos - start);
+}
+
+static bool parse_number(std::string_view tok, int& out) {
+  if (tok.empty() || tok.size() > 6) return false;
+  out = 0;
+  for (char c : tok) {
+    if (c < '0' || c > '9') return false;
+    out = out * 10 + (c - '0');
+  }
+  return true;
+}
+
+static bool parse_piece(char ch, board::Piece& p) {
+  char upper = static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
+  if (upper != 'P' && upper != 'R' && upper != 'N' && upper != 'B' && upper != 'Q' && upper != 'K') return false;
+  p.type = upper;
+  p.white = ch == upper;
+  return true;
+}
+
+size_t parse_position(std::string_view text, board::State& state) {
+  size_t pos = 0;
+  std::string_view name = next_token(text, pos);
+  int v = 0;
+  while (v < 3 && name != VARIANT_NAMES[v]) ++v;
+  if (v == 3) return 0;
+  board::Variant variant = static_cast<board::Variant>(v);
+
+  // placement into a local board first, so a bad position leaves state alone
+  std::string_view placement = next_token(text, pos);
+  board::Square cells[board::NUM_COLS][11];
+  int col = 0, row = 0;
+  for (size_t i = 0; i <= placement.size(); ++i) {
+    char ch = i < placement.size() ? placement[i] : '/';
+    if (col >= board::NUM_COLS) return 0;
+    int maxr = board::max_row(variant, col);
+    if (ch == '/') {
+      if (row != maxr || ++col > board::NUM_COLS) return 0;
+      row = 0;
+    } else if (ch >= '0' && ch <= '9') {
+      int run = ch - '0';
+      if (i + 1 < placement.size() && placement[i + 1] >= '0' && placement[i + 1] <= '9') run = run * 10 + (placement[++i] - '0');
+      if (run == 0 || row + run > maxr) return 0;
+      for (; run > 0; --run) cells[col][row++] = std::nullopt;
+    } else {
+      board::Piece p;
+      if (row >= maxr || !parse_piece(ch, p)) return 0;
+      cells[col][row++] = p;
+    }
+  }
+  if (col != board::NUM_COLS) return 0;
+
+  std::string_view side = next_token(text, pos);
+  if (side != "w" && side != "b") return 0;
+  bool white_to_play = side == "w";
+  size_t used = pos;
+
+  // optional tail: ep square, halfmove clock, fullmove number
+  std::optional<board::Move> prev_move;
+  int halfmove = 0, fullmove = 1;
+  size_t at = pos;
+  std::string_view ep = next_token(text, at);
+  bool have_ep = ep == "-";
+  if (!have_ep && ep.size() >= 2) {
+    int ep_col = std::tolower(static_cast<unsigned char>(ep[0])) - 'a', ep_row = 0;
+    if (ep_col >= 0 && ep_col < board::NUM_COLS && parse_number(ep.substr(1), ep_row)) {
+      ep_row -= 1;
+      // the pawn that just double-stepped over it, the side not to move
+      int to_row = white_to_play ? ep_row - 1 : ep_row + 1;
+      int from_row = white_to_play ? ep_row + 1 : ep_row - 1;
+      int maxr = board::max_row(variant, ep_col);
+      if (ep_row < 0 || ep_row >= maxr || to_row < 0 || to_row >= maxr || from_row < 0 || from_row >= maxr ||
+          cells[ep_col][ep_row] || cells[ep_col][from_row])
+        return 0;
+      const board::Square& pawn = cells[ep_col][to_row];
+      if (!pawn || pawn->type != 'P' || pawn->white == white_to_play) return 0;
+      prev_move = board::Move{ ep_col, from_row, ep_col, to_row, false, false, false };
+      have_ep = true;
+    }
+  }
+  if (have_ep) {
+    used = pos = at;
+    std::string_view half = next_token(text, at);
+    if (parse_number(half, halfmove)) {
+      used = pos = at;
+      std::string_view full = next_token(text, at);
+      if (parse_number(full, fullmove) && fullmove > 0) used = at;
+      else fullmove = 1;
+    } else {
+      halfmove = 0;
+    }
+  }
+
+  state.variant = variant;
+  for (int c = 0; c < board::NUM_COLS; ++c) {
+    auto& column = state.cells[static_cast<size_t>(c)];
+    int maxr = board::max_row(variant, c);
+    if (static_cast<int>(column.size()) != maxr) column.resize(static_cast<size_t>(maxr));
+    for (int r = 0; r < maxr; ++r) column[static_cast<size_t>(r)] = cells[c][r];
+  }
+  state.white_to_play = white_to_play;
+  state.prev_move = prev_move;
+  state.halfmove_clock = halfmove;
+  state.fullmove = fullmove;
+  state.refresh();
+  return used;
+}
+
+std::optional<board::State> parse_position(std::string_view text) {
+  board::State state;
+  size_t used = parse_position(text, state);
+  if (used == 0) return std::nullopt;
+  for (; used < text.size(); ++used)
+    if (!is_space(text[used])) return std::nullopt;
+  return state;
+}
+
+std::string format_position(const board::State& state) {
+  std::string out = VARIANT_NAMES[static_cast<int>(state.variant)];
+  out += ' ';
+  for (int c = 0; c < board::NUM_COLS; ++c) {
+    if (c > 0) out += '/';
+    int empty = 0;
+    int maxr = static_cast<int>(state.cells[static_cast<size_t>(c)].size());
+    for (int r = 0; r < maxr; ++r) {
+      const board::Square& sq = state.cells[static_cast<size_t>(c)][static_cast<size_t>(r)];
+      if (!sq) {
+        ++empty;
+        continue;
+      }
+      if (empty > 0) out += std::to_string(empty);
+      empty = 0;
+      out += sq->white ? sq->type : static_cast<char>(std::tolower(static_cast<unsigned char>(sq->type)));
+    }
+    if (empty > 0) out += std::to_string(empty);
+  }
+  out += state.white_to_play ? " w " : " b ";
+  // ep square: the one the last double step passed over
+  const auto& pm = state.prev_move;
+  if (pm && std::abs(pm->to_row - pm->from_row) == 2)
+    out += board::square_notation(pm->to_col, (pm->from_row + pm->to_row) / 2);
+  else
+    out += '-';
+  out += ' ' + std::to_string(state.halfmove_clock) + ' ' + std::to_string(state.fullmove);
+  return out;
+}
+
 std::optional<board::Move> parse_move(const std::string& s) {
   // PeP from to captured (en passant)
   {
@@ -123,5 +284,50 @@ std::string format_move_ep(const board::Move& m, bool piece_white) {
   return "PeP " + from_sq + " " + to_sq + " " + cap_sq;
 }
 
+std::optional<search::SearchLimits> parse_go(const std::string& s) {
+  std::istringstream iss(s);
+  std::string tok;
+  if (!(iss >> tok) || tok != "go") return std::nullopt;
+  search::SearchLimits limits;
+  while (iss >> tok) {
+    if (tok == "infinite") {
+      limits.infinite = true;
+      continue;
+    }
+    // signed: negative contempt prefers draws
+    if (tok == "contempt") {
+      if (!(iss >> limits.contempt)) return std::nullopt;
+      continue;
+    }
+    int* field = nullptr;
+    if (tok == "wtime") field = &limits.wtime_ms;
+    else if (tok == "btime") field = &limits.btime_ms;
+    else if (tok == "winc") field = &limits.winc_ms;
+    else if (tok == "binc") field = &limits.binc_ms;
+    else if (tok == "movetime") field = &limits.movetime_ms;
+    else if (tok == "nodes") field = &limits.max_nodes;
+    else if (tok == "depth") field = &limits.max_depth;
+    else if (tok == "multipv") field = &limits.multipv;
+    else return std::nullopt;
+    long long v = 0;
+    if (!(iss >> v) || v < 0) return std::nullopt;
+    *field = static_cast<int>(std::min<long long>(v, std::numeric_limits<int>::max()));
+  }
+  return limits;
+}
+
+std::string format_info(const search::SearchInfo& info) {
+  std::ostringstream oss;
+  oss << "info depth " << info.depth << " seldepth " << info.seldepth;
+  if (info.multipv > 0) oss << " multipv " << info.multipv;
+  oss << " score " << info.score << " nodes " << info.nodes << " nps " << info.nps
+      << " time " << info.time_ms << " hashfull " << info.hashfull;
+  if (!info.pv.empty()) {
+    oss << " pv";
+    for (const board::Move& m : info.pv) oss << ' ' << format_move(m);
+  }
+  return oss.str();
+}
+
 }  // namespace protocol
 }  // namespace hexchess
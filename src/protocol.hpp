@@ -1,8 +1,10 @@
 #pragma once
 
 #include "board.hpp"
+#include "search.hpp"
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace hexchess {
@@ -11,6 +13,16 @@ namespace protocol {
 // 11 lines (one per col) then white/black. upper=white lower=black . or space=empty
 std::optional<board::State> parse_board(const std::vector<std::string>& lines);
 
+// one line, FEN-like: variant, columns A..K from row 1 up split by '/' (upper=white lower=black,
+// digits = that many empty cells), side w/b, ep square or -, halfmove clock, fullmove number:
+// glinski 6/P5p/RP4pr/N1P3p1n/Q2P2p2q/BBB1P1p1bbb/K2P2p2k/N1P3p1n/RP4pr/P5p/6 w - 0 1
+// the last three may be left out. fills state in place without allocating; returns the
+// characters used, 0 (state unchanged) if text doesnt start with a position
+size_t parse_position(std::string_view text, board::State& state);
+// whole text must be a position
+std::optional<board::State> parse_position(std::string_view text);
+std::string format_position(const board::State& state);
+
 // a1b2 or N A3 B4 or NxB A3 B4 or PeP from to captured
 std::optional<board::Move> parse_move(const std::string& s);
 
@@ -22,5 +34,11 @@ std::string format_move_long(const board::Move& m, char piece_type, std::optiona
 // PeP from to captured square. piece_white = moving pawn
 std::string format_move_ep(const board::Move& m, bool piece_white);
 
+// go [wtime N] [btime N] [winc N] [binc N] [movetime N] [nodes N] [depth N] [multipv K] [contempt N] [infinite]
+std::optional<search::SearchLimits> parse_go(const std::string& s);
+
+// info depth D seldepth S [multipv K] score X nodes N nps N time MS hashfull H pv A1B2 ...
+std::string format_info(const search::SearchInfo& info);
+
 }  // namespace protocol
 }  // namespace hexchess
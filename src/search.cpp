@@ -1,5 +1,7 @@
 #include "search.hpp"
+#include "tablebase.hpp"
 #include <algorithm>
+#include <cstdlib>
 #include <limits>
 
 namespace hexchess {
@@ -7,103 +9,387 @@ namespace search {
 
 using namespace board;
 
-const int KING_CAPTURED_WHITE_WINS = 10000;
-const int KING_CAPTURED_BLACK_WINS = -10000;
-const int CULL_MARGIN = 10;
+const int CULL_MARGIN = 1000;  // centipawns
 const int CULL_MIN_DEPTH = 4;
+// root window. finite so alpha - CULL_MARGIN cant overflow
+const int SCORE_INF = 1000000;
+// history saturates here and is halved at the start of every search
+const int HISTORY_MAX = 1 << 20;
 
-static constexpr int TT_SIZE = 1 << 18;  // 256k entries
+// time management. soft = clock/MOVES_TO_GO + most of the increment, hard caps overruns
+const int MOVES_TO_GO = 30;
+const int MOVE_OVERHEAD_MS = 20;
+const int HARD_SOFT_RATIO = 4;
+// soft limit stretch when the best move changed in the last iteration
+const double UNSTABLE_SCALE = 1.6;
 
-int minimax(State& state, int depth, int alpha, int beta, SearchContext& ctx) {
+void SearchContext::poll() {
+  if (!control && hard_ms == 0 && !on_info) return;
+  if ((nodes_used & (STOP_POLL_NODES - 1)) != 0) return;
+  if (control) {
+    if (control->stop.load(std::memory_order_relaxed)) stopped = true;
+    // ponderhit: limits apply from here on, time and nodes spent pondering count
+    pondering = control->pondering.load(std::memory_order_relaxed);
+  }
+  if (pondering || (hard_ms == 0 && !on_info)) return;
+  int elapsed = elapsed_ms();
+  if (hard_ms > 0 && elapsed >= hard_ms) stopped = true;
+  if (on_info && !lines.empty() && elapsed - last_info_ms >= INFO_PERIOD_MS) report_info();
+}
+
+int SearchContext::elapsed_ms() const {
+  return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start).count());
+}
+
+static int tt_hashfull(const std::vector<TTEntry>& tt) {
+  int used = 0;
+  int n = std::min<int>(1000, static_cast<int>(tt.size()));
+  for (int i = 0; i < n; ++i)
+    if (tt[static_cast<size_t>(i)].key != 0) used++;
+  return n > 0 ? used * 1000 / n : 0;
+}
+
+void SearchContext::report_info() {
+  if (!on_info || pondering) return;
+  int elapsed = elapsed_ms();
+  int hashfull = tt ? tt_hashfull(*tt) : 0;
+  for (SearchInfo& info : lines) {
+    info.nodes = nodes_used;
+    info.time_ms = elapsed;
+    info.nps = static_cast<int>(static_cast<int64_t>(info.nodes) * 1000 / std::max(1, elapsed));
+    info.hashfull = hashfull;
+    (*on_info)(info);
+  }
+  last_info_ms = elapsed;
+}
+
+// soft: dont start another depth past this. hard: abort mid-depth. 0 = none
+static void plan_time(const SearchLimits& limits, bool white, int& soft_ms, int& hard_ms) {
+  soft_ms = hard_ms = 0;
+  if (limits.infinite) return;
+  if (limits.movetime_ms > 0) {
+    soft_ms = hard_ms = limits.movetime_ms;
+    return;
+  }
+  int time = white ? limits.wtime_ms : limits.btime_ms;
+  int inc = white ? limits.winc_ms : limits.binc_ms;
+  if (time <= 0) return;
+  int usable = std::max(1, time - MOVE_OVERHEAD_MS);
+  soft_ms = std::min(usable, time / MOVES_TO_GO + inc * 3 / 4);
+  hard_ms = std::min(usable / 2, soft_ms * HARD_SOFT_RATIO);
+  hard_ms = std::max(hard_ms, std::min(soft_ms, usable));
+  soft_ms = std::max(1, std::min(soft_ms, hard_ms));
+}
+
+static bool same_move(const Move& a, const Move& b) {
+  return a.from_col == b.from_col && a.from_row == b.from_row &&
+         a.to_col == b.to_col && a.to_row == b.to_row;
+}
+
+// TT keeps mate scores as distance from the stored node, the search as distance from the root
+static int score_to_tt(int score, int ply) {
+  if (score >= MATE_BOUND) return score + ply;
+  if (score <= -MATE_BOUND) return score - ply;
+  return score;
+}
+
+static int score_from_tt(int score, int ply) {
+  if (score >= MATE_BOUND) return score - ply;
+  if (score <= -MATE_BOUND) return score + ply;
+  return score;
+}
+
+// TTEntry::flag: the score is exact, or only a bound (the search failed high or low)
+static constexpr uint8_t TT_EXACT = 0;
+static constexpr uint8_t TT_LOWER = 1;
+static constexpr uint8_t TT_UPPER = 2;
+
+// true = cutoff, score set: deep enough and the bound settles the window. hash_move and
+// static_eval set on any hit. root always needs a move
+static bool probe_tt(SearchContext& ctx, uint64_t h, int depth, int ply, int alpha, int beta,
+    std::optional<Move>& hash_move, int& static_eval, int& score) {
+  if (!ctx.tt || ctx.tt_mask <= 0) return false;
+  const TTEntry& entry = (*ctx.tt)[h & ctx.tt_mask];
+  if (entry.key != h) return false;
+  hash_move = entry.best_move;
+  static_eval = entry.static_eval;
+  if (entry.depth < depth || ply == 0) return false;
+  int s = score_from_tt(entry.score, ply);
+  if (entry.flag == TT_LOWER && s < beta) return false;
+  if (entry.flag == TT_UPPER && s > alpha) return false;
+  score = s;
+  return true;
+}
+
+// alpha, beta: the window the node's moves were searched with
+static void store_tt(SearchContext& ctx, uint64_t h, int score, int alpha, int beta, int depth, int ply,
+    const std::optional<Move>& best_move, int static_eval) {
+  if (!ctx.tt || ctx.tt_mask <= 0) return;
+  TTEntry& e = (*ctx.tt)[h & ctx.tt_mask];
+  // same position: keep the eval an earlier visit computed
+  if (e.key != h || static_eval != EVAL_NONE) e.static_eval = static_eval;
+  e.key = h;
+  e.score = score_to_tt(score, ply);
+  e.depth = depth;
+  e.flag = score <= alpha ? TT_UPPER : score >= beta ? TT_LOWER : TT_EXACT;
+  e.best_move = best_move;
+}
+
+// previous depth's pv move first while still on the pv, else hash move. then killers
+static void order(SearchContext& ctx, std::vector<Move>& moves, const State& state,
+    const attacks::AttackMap& map, std::optional<Move> hash_move, int ply) {
+  if (ctx.follow_pv && ply < ctx.prev_pv_len) hash_move = ctx.prev_pv[ply];
+  else ctx.follow_pv = false;
+  std::optional<Move> k1 = (ply < MAX_PLY) ? ctx.killers[ply][0] : std::nullopt;
+  std::optional<Move> k2 = (ply < MAX_PLY) ? ctx.killers[ply][1] : std::nullopt;
+  moves::order_moves(moves, state, hash_move, k1, k2, ctx.history, &map);
+}
+
+// quiet move caused a cutoff: killer for this ply, history for the side
+static void store_cutoff(SearchContext& ctx, const State& state, const Move& m, int depth, int ply) {
+  if (m.capture || m.en_passant || ply >= MAX_PLY) return;
+  if (!(ctx.killers[ply][0] && same_move(*ctx.killers[ply][0], m))) {
+    ctx.killers[ply][1] = ctx.killers[ply][0];
+    ctx.killers[ply][0] = m;
+  }
+  if (ctx.history) {
+    int& h = moves::history_entry(*ctx.history, state.white_to_play, m);
+    h = std::min(h + depth * depth, HISTORY_MAX);
+  }
+}
+
+// multipv: excluded moves are already in an earlier pv slot
+static std::vector<Move> root_move_list(const std::vector<RootMove>& root_moves) {
+  std::vector<Move> out;
+  out.reserve(root_moves.size());
+  for (const RootMove& rm : root_moves)
+    if (!rm.excluded) out.push_back(rm.move);
+  return out;
+}
+
+static void note_root_move(SearchContext& ctx, const Move& m, bool white, int score) {
+  for (RootMove& rm : *ctx.root_moves) {
+    if (!same_move(rm.move, m)) continue;
+    rm.score = white ? score : -score;
+    rm.searched = true;
+    return;
+  }
+}
+
+// best first, then searched by score. ties and unsearched keep their order
+static void sort_root_moves(std::vector<RootMove>& root_moves, const std::optional<Move>& best) {
+  std::stable_sort(root_moves.begin(), root_moves.end(), [&](const RootMove& a, const RootMove& b) {
+    bool a_best = best && same_move(a.move, *best);
+    bool b_best = best && same_move(b.move, *best);
+    if (a_best != b_best) return a_best;
+    if (a.searched != b.searched) return a.searched;
+    return a.score > b.score;
+  });
+  for (RootMove& rm : root_moves) rm.searched = false;
+}
+
+// new best at ply: m followed by the child's pv
+static void update_pv(SearchContext& ctx, int ply, const Move& m) {
+  ctx.pv[ply][0] = m;
+  int child_len = ctx.pv_len[ply + 1];
+  for (int i = 0; i < child_len; ++i) ctx.pv[ply][i + 1] = ctx.pv[ply + 1][i];
+  ctx.pv_len[ply] = child_len + 1;
+}
+
+// same position earlier on the path or in the game. only back to the last pawn move or
+// capture, and only same side to move (every 2nd ply, a repeat needs at least 4)
+static bool is_repetition(const SearchContext& ctx, const State& state) {
+  int n = static_cast<int>(ctx.keys.size());
+  int limit = std::min(state.halfmove_clock, n);
+  for (int i = 4; i <= limit; i += 2)
+    if (ctx.keys[static_cast<size_t>(n - i)] == state.key) return true;
+  return false;
+}
+
+// mate distance pruning: nothing below ply can beat a king capture on the next ply.
+// true = window empty, score set
+static bool mate_distance_prune(int ply, int& alpha, int& beta, int& score) {
+  int best = KING_CAPTURED_WHITE_WINS - (ply + 1);
+  int worst = KING_CAPTURED_BLACK_WINS + (ply + 1);
+  if (best <= alpha) score = best;
+  else if (worst >= beta) score = worst;
+  else {
+    alpha = std::max(alpha, worst);
+    beta = std::min(beta, best);
+    return false;
+  }
+  return true;
+}
+
+// tablebase::probe plies as a score at ply, white POV
+static int tablebase_score(int plies, bool white, int ply, const SearchContext& ctx) {
+  if (plies == 0) return ctx.draw_score;
+  int at = ply + std::abs(plies);
+  return (plies > 0) == white ? KING_CAPTURED_WHITE_WINS - at : KING_CAPTURED_BLACK_WINS + at;
+}
+
+// node's key on ctx.keys while its children are searched
+struct PathEntry {
+  std::vector<uint64_t>& keys;
+  PathEntry(std::vector<uint64_t>& k, uint64_t key) : keys(k) { keys.push_back(key); }
+  ~PathEntry() { keys.pop_back(); }
+};
+
+int minimax(State& state, int depth, int ply, int alpha, int beta, SearchContext& ctx) {
   ctx.nodes_used++;
-  if (ctx.budget_exceeded()) return eval::evaluate(state);
+  ctx.poll();
+  ctx.pv_len[ply] = 0;
+  if (ply > ctx.seldepth) ctx.seldepth = ply;
+  if (ctx.budget_exceeded()) return eval::evaluate_cached(state);
+  if (ply > 0 && is_repetition(ctx, state)) return ctx.draw_score;
+  int mate_score = 0;
+  if (ply > 0 && mate_distance_prune(ply, alpha, beta, mate_score)) return mate_score;
+  if (ply > 0)
+    if (auto tb = tablebase::probe(state)) return tablebase_score(*tb, state.white_to_play, ply, ctx);
 
-  auto moves = moves::generate(state);
-  if (moves.empty()) return eval::evaluate(state);
+  // built lazily: a leaf only pays for it on an eval cache miss
+  attacks::AttackMap map(state);
+  if (depth == 0) return eval::evaluate_cached(state, map);
 
-  if (depth == 0) return eval::evaluate(state);
+  auto moves = moves::generate(state, map);
+  if (moves.empty()) return eval::evaluate_cached(state, map);
+
+  uint64_t h = state.hash();
+  std::optional<Move> hash_move;
+  int static_eval = EVAL_NONE;
+  int tt_score = 0;
+  // after mate distance pruning: a narrowed window's fail high or low is still only a bound
+  const int window_alpha = alpha, window_beta = beta;
+  if (probe_tt(ctx, h, depth, ply, alpha, beta, hash_move, static_eval, tt_score)) return tt_score;
+  order(ctx, moves, state, map, hash_move, ply);
 
   // futility: skip kids if static eval obviously bad at depth >= 4
   if (depth >= CULL_MIN_DEPTH) {
-    int static_eval = eval::evaluate(state);
+    if (static_eval == EVAL_NONE) static_eval = eval::evaluate_cached(state, map);
     if (state.white_to_play && static_eval <= alpha - CULL_MARGIN)
       return static_eval;
     if (!state.white_to_play && static_eval >= beta + CULL_MARGIN)
       return static_eval;
   }
 
+  PathEntry path(ctx.keys, h);
   if (state.white_to_play) {
     int max_eval = std::numeric_limits<int>::min();
+    std::optional<Move> best_move;
     for (const Move& m : moves) {
       State::UndoInfo ui = state.make_move(m);
-      int score = eval::evaluate(state);
+      int score;
       bool terminal = false;
       if (ui.captured && ui.captured->type == 'K') {
-        score = KING_CAPTURED_WHITE_WINS;
+        score = KING_CAPTURED_WHITE_WINS - (ply + 1);
         terminal = true;
+        ctx.pv_len[ply + 1] = 0;
       }
-      if (!terminal) score = minimax(state, depth - 1, alpha, beta, ctx);
+      if (!terminal) score = minimax(state, depth - 1, ply + 1, alpha, beta, ctx);
       state.undo_move(m, ui);
+      ctx.follow_pv = false;
       if (ctx.budget_exceeded()) return max_eval;
-      max_eval = std::max(max_eval, score);
+      if (score > max_eval) {
+        max_eval = score;
+        best_move = m;
+        update_pv(ctx, ply, m);
+      }
       alpha = std::max(alpha, score);
-      if (beta <= alpha) break;
+      if (beta <= alpha) {
+        store_cutoff(ctx, state, m, depth, ply);
+        break;
+      }
     }
+    store_tt(ctx, h, max_eval, window_alpha, window_beta, depth, ply, best_move, static_eval);
     return max_eval;
   } else {
     int min_eval = std::numeric_limits<int>::max();
+    std::optional<Move> best_move;
     for (const Move& m : moves) {
       State::UndoInfo ui = state.make_move(m);
-      int score = eval::evaluate(state);
+      int score;
       bool terminal = false;
       if (ui.captured && ui.captured->type == 'K') {
-        score = KING_CAPTURED_BLACK_WINS;
+        score = KING_CAPTURED_BLACK_WINS + (ply + 1);
         terminal = true;
+        ctx.pv_len[ply + 1] = 0;
       }
-      if (!terminal) score = minimax(state, depth - 1, alpha, beta, ctx);
+      if (!terminal) score = minimax(state, depth - 1, ply + 1, alpha, beta, ctx);
       state.undo_move(m, ui);
+      ctx.follow_pv = false;
       if (ctx.budget_exceeded()) return min_eval;
-      min_eval = std::min(min_eval, score);
+      if (score < min_eval) {
+        min_eval = score;
+        best_move = m;
+        update_pv(ctx, ply, m);
+      }
       beta = std::min(beta, score);
-      if (beta <= alpha) break;
+      if (beta <= alpha) {
+        store_cutoff(ctx, state, m, depth, ply);
+        break;
+      }
     }
+    store_tt(ctx, h, min_eval, window_alpha, window_beta, depth, ply, best_move, static_eval);
     return min_eval;
   }
 }
 
 int minimax_node(Node& node, int depth, int ply, int alpha, int beta, SearchContext& ctx) {
   ctx.nodes_used++;
-  if (ctx.budget_exceeded()) return eval::evaluate(node.state);
+  ctx.poll();
+  ctx.pv_len[ply] = 0;
+  if (ply > ctx.seldepth) ctx.seldepth = ply;
+  if (ctx.budget_exceeded()) return eval::evaluate_cached(node.state);
+  if (ply > 0 && is_repetition(ctx, node.state)) {
+    node.best_score = ctx.draw_score;
+    return ctx.draw_score;
+  }
+  int mate_score = 0;
+  if (ply > 0 && mate_distance_prune(ply, alpha, beta, mate_score)) {
+    node.best_score = mate_score;
+    return mate_score;
+  }
+  if (ply > 0) {
+    if (auto tb = tablebase::probe(node.state)) {
+      node.best_score = tablebase_score(*tb, node.state.white_to_play, ply, ctx);
+      return node.best_score;
+    }
+  }
 
-  auto moves = moves::generate(node.state);
-  if (moves.empty()) return eval::evaluate(node.state);
+  // root: persistent list, already ordered by the last depth
+  bool at_root = ply == 0 && ctx.root_moves;
+  attacks::AttackMap map(node.state);
+  if (depth == 0) return eval::evaluate_cached(node.state, map);
 
-  if (depth == 0) return eval::evaluate(node.state);
+  auto moves = at_root ? root_move_list(*ctx.root_moves) : moves::generate(node.state, map);
+  if (moves.empty()) return eval::evaluate_cached(node.state, map);
 
   uint64_t h = node.state.hash();
   std::optional<Move> hash_move;
-  if (ctx.tt && ctx.tt_mask > 0) {
-    const TTEntry& entry = (*ctx.tt)[h & ctx.tt_mask];
-    if (entry.key == h) {
-      hash_move = entry.best_move;
-      if (entry.depth >= depth)
-        return entry.score;
-    }
+  int static_eval = EVAL_NONE;
+  int tt_score = 0;
+  const int window_alpha = alpha, window_beta = beta;
+  if (probe_tt(ctx, h, depth, ply, alpha, beta, hash_move, static_eval, tt_score)) {
+    node.best_move = hash_move;
+    node.best_score = tt_score;
+    return tt_score;
   }
-
-  std::optional<Move> k1 = (ply < MAX_PLY) ? ctx.killers[ply][0] : std::nullopt;
-  std::optional<Move> k2 = (ply < MAX_PLY) ? ctx.killers[ply][1] : std::nullopt;
-  moves::order_moves(moves, node.state, hash_move, k1, k2);
+  if (!at_root) order(ctx, moves, node.state, map, hash_move, ply);
 
   // futility: skip kids if static eval obviously bad at depth >= 4
   if (depth >= CULL_MIN_DEPTH) {
-    int static_eval = eval::evaluate(node.state);
+    if (static_eval == EVAL_NONE) static_eval = eval::evaluate_cached(node.state, map);
     if (node.state.white_to_play && static_eval <= alpha - CULL_MARGIN)
       return static_eval;
     if (!node.state.white_to_play && static_eval >= beta + CULL_MARGIN)
       return static_eval;
   }
 
+  // past record_plies the subtree isnt kept, search it without building nodes
+  bool record = ply + 1 < ctx.record_plies;
+  PathEntry path(ctx.keys, h);
+
   if (node.state.white_to_play) {
     int max_eval = std::numeric_limits<int>::min();
     std::optional<Move> best_move;
@@ -112,47 +398,47 @@ int minimax_node(Node& node, int depth, int ply, int alpha, int beta, SearchCont
       int score;
       bool terminal = false;
       if (ui.captured && ui.captured->type == 'K') {
-        score = KING_CAPTURED_WHITE_WINS;
+        score = KING_CAPTURED_WHITE_WINS - (ply + 1);
         terminal = true;
+        ctx.pv_len[ply + 1] = 0;
+      }
+      std::unique_ptr<Node> child;
+      if (record) {
+        child = std::make_unique<Node>();
+        child->state = node.state;
       }
-      auto child = std::make_unique<Node>();
-      child->state = node.state;
       if (terminal) {
-        child->best_score = score;
-      } else {
+        if (child) child->best_score = score;
+      } else if (child) {
         score = minimax_node(*child, depth - 1, ply + 1, alpha, beta, ctx);
+      } else {
+        score = minimax(node.state, depth - 1, ply + 1, alpha, beta, ctx);
       }
       node.state.undo_move(m, ui);
-      node.children.push_back({m, std::move(child)});
+      ctx.follow_pv = false;
+      if (child) node.children.push_back({m, std::move(child)});
 
       if (ctx.budget_exceeded()) {
         node.best_move = best_move ? best_move : std::optional<Move>(m);
         node.best_score = max_eval;
         return max_eval;
       }
+      if (at_root) note_root_move(ctx, m, true, score);
       if (score > max_eval) {
         max_eval = score;
         best_move = m;
+        update_pv(ctx, ply, m);
       }
       alpha = std::max(alpha, score);
       if (beta <= alpha) {
-        if (!m.capture && !m.en_passant && ply < MAX_PLY) {
-          ctx.killers[ply][1] = ctx.killers[ply][0];
-          ctx.killers[ply][0] = m;
-        }
+        store_cutoff(ctx, node.state, m, depth, ply);
         break;
       }
     }
     node.best_move = best_move;
     node.best_score = max_eval;
-    if (ctx.tt && ctx.tt_mask > 0) {
-      TTEntry& e = (*ctx.tt)[h & ctx.tt_mask];
-      e.key = h;
-      e.score = max_eval;
-      e.depth = depth;
-      e.flag = 0;
-      e.best_move = best_move;
-    }
+    if (!(at_root && ctx.excluding))
+      store_tt(ctx, h, max_eval, window_alpha, window_beta, depth, ply, best_move, static_eval);
     return max_eval;
   } else {
     int min_eval = std::numeric_limits<int>::max();
@@ -162,65 +448,158 @@ int minimax_node(Node& node, int depth, int ply, int alpha, int beta, SearchCont
       int score;
       bool terminal = false;
       if (ui.captured && ui.captured->type == 'K') {
-        score = KING_CAPTURED_BLACK_WINS;
+        score = KING_CAPTURED_BLACK_WINS + (ply + 1);
         terminal = true;
+        ctx.pv_len[ply + 1] = 0;
+      }
+      std::unique_ptr<Node> child;
+      if (record) {
+        child = std::make_unique<Node>();
+        child->state = node.state;
       }
-      auto child = std::make_unique<Node>();
-      child->state = node.state;
       if (terminal) {
-        child->best_score = score;
-      } else {
+        if (child) child->best_score = score;
+      } else if (child) {
         score = minimax_node(*child, depth - 1, ply + 1, alpha, beta, ctx);
+      } else {
+        score = minimax(node.state, depth - 1, ply + 1, alpha, beta, ctx);
       }
       node.state.undo_move(m, ui);
-      node.children.push_back({m, std::move(child)});
+      ctx.follow_pv = false;
+      if (child) node.children.push_back({m, std::move(child)});
 
       if (ctx.budget_exceeded()) {
         node.best_move = best_move ? best_move : std::optional<Move>(m);
         node.best_score = min_eval;
         return min_eval;
       }
+      if (at_root) note_root_move(ctx, m, false, score);
       if (score < min_eval) {
         min_eval = score;
         best_move = m;
+        update_pv(ctx, ply, m);
       }
       beta = std::min(beta, score);
       if (beta <= alpha) {
-        if (!m.capture && !m.en_passant && ply < MAX_PLY) {
-          ctx.killers[ply][1] = ctx.killers[ply][0];
-          ctx.killers[ply][0] = m;
-        }
+        store_cutoff(ctx, node.state, m, depth, ply);
         break;
       }
     }
     node.best_move = best_move;
     node.best_score = min_eval;
-    if (ctx.tt && ctx.tt_mask > 0) {
-      TTEntry& e = (*ctx.tt)[h & ctx.tt_mask];
-      e.key = h;
-      e.score = min_eval;
-      e.depth = depth;
-      e.flag = 0;
-      e.best_move = best_move;
-    }
+    if (!(at_root && ctx.excluding))
+      store_tt(ctx, h, min_eval, window_alpha, window_beta, depth, ply, best_move, static_eval);
     return min_eval;
   }
 }
 
-void iterative_deepen(Node& root, int max_nodes, std::function<bool()> stop) {
-  static std::vector<TTEntry> g_tt(TT_SIZE);
+// pv cut short by a TT hit: keep following TT best moves while they're legal
+static void extend_pv_from_tt(const SearchContext& ctx, State state, std::vector<Move>& pv) {
+  for (const Move& m : pv) {
+    State::UndoInfo ui = state.make_move(m);
+    if (ui.captured && ui.captured->type == 'K') return;
+  }
+  while (static_cast<int>(pv.size()) < MAX_PLY && ctx.tt && ctx.tt_mask > 0) {
+    uint64_t h = state.hash();
+    const TTEntry& entry = (*ctx.tt)[h & ctx.tt_mask];
+    if (entry.key != h || !entry.best_move) break;
+    auto legal = moves::generate(state);
+    auto it = std::find_if(legal.begin(), legal.end(), [&](const Move& m) { return same_move(m, *entry.best_move); });
+    if (it == legal.end()) break;
+    pv.push_back(*it);
+    State::UndoInfo ui = state.make_move(*it);
+    if (ui.captured && ui.captured->type == 'K') break;
+  }
+}
+
+void SearchTables::clear() {
+  std::fill(tt.begin(), tt.end(), TTEntry{});
+  for (auto& ply : killers) ply.fill(std::nullopt);
+  for (auto& side : history)
+    for (auto& from : side) from.fill(0);
+}
+
+void iterative_deepen(Node& root, const SearchLimits& limits, SearchControl* control, InfoCallback on_info) {
+  static SearchTables g_tables;
+  iterative_deepen(root, limits, g_tables, control, std::move(on_info));
+}
 
+void iterative_deepen(Node& root, const SearchLimits& limits, SearchTables& tables, SearchControl* control,
+    InfoCallback on_info) {
   SearchContext ctx;
-  ctx.max_nodes = max_nodes;
-  ctx.tt = &g_tt;
-  ctx.tt_mask = TT_SIZE - 1;
+  ctx.max_nodes = limits.infinite ? 0 : limits.max_nodes;
+  ctx.start = std::chrono::steady_clock::now();
+  int soft_ms = 0;
+  plan_time(limits, root.state.white_to_play, soft_ms, ctx.hard_ms);
+  ctx.control = control;
+  ctx.record_plies = limits.record_plies;
+  if (control) {
+    ctx.stopped = control->stop.load();
+    ctx.pondering = control->pondering.load();
+    if (ctx.pondering) ctx.record_plies = std::min(ctx.record_plies, PONDER_RECORD_PLIES);
+  }
+  ctx.tt = &tables.tt;
+  ctx.tt_mask = static_cast<int>(tables.tt.size()) - 1;
+  if (on_info) ctx.on_info = &on_info;
+  root.pv.clear();
+  ctx.killers = tables.killers;
+  for (auto& side : tables.history)
+    for (auto& from : side)
+      for (int& v : from) v /= 2;
+  ctx.history = &tables.history;
+  ctx.keys = root.history;
+  ctx.keys.reserve(ctx.keys.size() + MAX_PLY + 1);
+  ctx.draw_score = root.state.white_to_play ? -limits.contempt : limits.contempt;
+
+  // the tables know the best move, no search needed
+  int tb_plies = 0;
+  if (auto tb_move = tablebase::best_move(root.state, tb_plies)) {
+    root.best_move = tb_move;
+    root.best_score = tablebase_score(tb_plies, root.state.white_to_play, 0, ctx);
+    root.pv = { *tb_move };
+    SearchInfo line;
+    line.depth = 1;
+    line.score = root.best_score;
+    line.pv = root.pv;
+    ctx.lines = { line };
+    ctx.report_info();
+    return;
+  }
 
-  for (int d = 1; ; ++d) {
-    if (stop && stop()) break;
-    ctx.nodes_used = 0;
+  // generated once, statically ordered, then re-sorted after every depth
+  std::vector<RootMove> root_moves;
+  {
+    attacks::AttackMap map(root.state);
+    auto moves = moves::generate(root.state, map);
+    order(ctx, moves, root.state, map, std::nullopt, 0);
+    bool white = root.state.white_to_play;
+    for (const Move& m : moves) {
+      State::UndoInfo ui = root.state.make_move(m);
+      bool king_taken = ui.captured && ui.captured->type == 'K';
+      bool legal = king_taken || !attacks::king_attacked(attacks::AttackMap(root.state), white);
+      root.state.undo_move(m, ui);
+      if (legal) root_moves.push_back(RootMove{ m });
+    }
+    // every move hangs the king: lost anyway, search them all
+    if (root_moves.empty())
+      for (const Move& m : moves) root_moves.push_back(RootMove{ m });
+  }
+  ctx.root_moves = &root_moves;
+  int multipv = std::max(1, std::min(limits.multipv, static_cast<int>(root_moves.size())));
+  int record_plies = ctx.record_plies;
+
+  int max_depth = limits.max_depth > 0 ? std::min(limits.max_depth, MAX_PLY) : MAX_PLY;
+  int prev_iter_nodes = 0;
+  for (int d = 1; d <= max_depth; ++d) {
+    if (ctx.stopped) break;
+    // search the last pv first
+    ctx.prev_pv_len = static_cast<int>(std::min<size_t>(root.pv.size(), MAX_PLY));
+    for (int i = 0; i < ctx.prev_pv_len; ++i) ctx.prev_pv[i] = root.pv[static_cast<size_t>(i)];
+    ctx.follow_pv = true;
+    int iter_start_nodes = ctx.nodes_used;
+    int iter_start_ms = ctx.elapsed_ms();
 
-    auto moves = moves::generate(root.state);
-    if (moves.empty()) break;
+    if (root_moves.empty()) break;
 
     // save tree in case we exceed budget mid-depth
     decltype(root.children) saved_children = std::move(root.children);
@@ -228,18 +607,88 @@ void iterative_deepen(Node& root, int max_nodes, std::function<bool()> stop) {
     auto saved_best_score = root.best_score;
     root.children.clear();
 
-    minimax_node(root, d, 0, std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), ctx);
+    // multipv: slot k searches the root without the first k pv moves, full window.
+    // only the first slot records the tree and decides root.best_move
+    std::vector<SearchInfo> lines;
+    std::optional<Move> slot0_move;
+    int slot0_score = 0;
+    for (int slot = 0; slot < multipv; ++slot) {
+      if (slot > 0) {
+        for (RootMove& rm : root_moves)
+          if (same_move(rm.move, lines.back().pv.front())) rm.excluded = true;
+        ctx.excluding = true;
+        ctx.record_plies = 0;
+      }
+      minimax_node(root, d, 0, -SCORE_INF, SCORE_INF, ctx);
+      if (ctx.budget_exceeded() || !root.best_move) break;
+      if (slot == 0) {
+        slot0_move = root.best_move;
+        slot0_score = root.best_score;
+      }
+      SearchInfo line;
+      line.depth = d;
+      line.seldepth = ctx.seldepth;
+      line.score = root.best_score;
+      line.multipv = multipv > 1 ? slot + 1 : 0;
+      line.pv.assign(ctx.pv[0].begin(), ctx.pv[0].begin() + ctx.pv_len[0]);
+      if (line.pv.empty()) line.pv.push_back(*root.best_move);
+      extend_pv_from_tt(ctx, root.state, line.pv);
+      lines.push_back(std::move(line));
+    }
+    if (multipv > 1) {
+      for (RootMove& rm : root_moves) rm.excluded = false;
+      ctx.excluding = false;
+      ctx.record_plies = record_plies;
+      if (slot0_move) {
+        root.best_move = slot0_move;
+        root.best_score = slot0_score;
+      }
+    }
 
+    // stopped or out of budget: unwind to the last completed depth, a partial one can score from
+    // truncated subtrees. with none, keep the partial move (scored statically if no root move finished)
     if (ctx.budget_exceeded()) {
-      // keep partial if we got a move, restore only when we have nothing
-      if (!root.best_move) {
+      if (saved_best_move || !root.best_move) {
         root.children = std::move(saved_children);
         root.best_move = saved_best_move;
         root.best_score = saved_best_score;
+      } else if (root.best_score == std::numeric_limits<int>::min() ||
+          root.best_score == std::numeric_limits<int>::max()) {
+        root.best_score = eval::evaluate_cached(root.state);
       }
       break;
     }
+
+    sort_root_moves(root_moves, root.best_move);
+
+    root.pv = lines.front().pv;
+    ctx.lines = std::move(lines);
+    if (d == 1 || ctx.elapsed_ms() - ctx.last_info_ms >= limits.info_interval_ms) ctx.report_info();
+
+    // king capture within the searched depth: deeper only finds longer lines
+    int mate_plies = KING_CAPTURED_WHITE_WINS - std::abs(root.best_score);
+    if (std::abs(root.best_score) >= MATE_BOUND && mate_plies <= d && !ctx.pondering && !limits.infinite) break;
+
+    // soft limit, stretched while the best move is still changing
+    if (soft_ms > 0 && !ctx.pondering) {
+      int elapsed = ctx.elapsed_ms();
+      bool unstable = d > 1 && saved_best_move && root.best_move && !same_move(*saved_best_move, *root.best_move);
+      int soft = unstable ? std::min(ctx.hard_ms, static_cast<int>(soft_ms * UNSTABLE_SCALE)) : soft_ms;
+      if (elapsed >= soft) break;
+      // dont start a depth the effective branching factor says wont finish
+      int iter_nodes = ctx.nodes_used - iter_start_nodes;
+      double ebf = prev_iter_nodes > 0 ? static_cast<double>(iter_nodes) / prev_iter_nodes : 2.0;
+      ebf = std::max(ebf, 1.5);
+      double predicted_ms = (elapsed - iter_start_ms) * ebf;
+      if (elapsed + predicted_ms > ctx.hard_ms) break;
+      prev_iter_nodes = iter_nodes;
+    } else {
+      prev_iter_nodes = ctx.nodes_used - iter_start_nodes;
+    }
   }
+  tables.killers = ctx.killers;
+  // last completed depth, if throttled above or nodes moved on since
+  if (!ctx.lines.empty() && ctx.nodes_used != ctx.lines.front().nodes) ctx.report_info();
 }
 
 Node* find_child(Node& root, const Move& move) {
@@ -4,8 +4,11 @@
 #include "moves.hpp"
 #include "eval.hpp"
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <functional>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <vector>
@@ -13,6 +16,9 @@
 namespace hexchess {
 namespace search {
 
+// static_eval not computed yet
+static constexpr int EVAL_NONE = std::numeric_limits<int>::min();
+
 // TT entry
 struct TTEntry {
   uint64_t key = 0;
@@ -20,6 +26,7 @@ struct TTEntry {
   int depth = 0;
   uint8_t flag = 0;  // 0=exact, 1=lower, 2=upper
   std::optional<board::Move> best_move;
+  int static_eval = EVAL_NONE;
 };
 
 struct SearchResult {
@@ -34,28 +41,136 @@ struct Node {
   std::optional<board::Move> best_move;
   int best_score = 0;
   std::vector<std::pair<board::Move, std::unique_ptr<Node>>> children;
+  std::vector<board::Move> pv;  // root only: pv of the last completed depth
+  std::vector<uint64_t> history;  // root only: keys of earlier game positions, oldest first
 };
 
 // 2 killer slots per ply
 static constexpr int MAX_PLY = 64;
 
+// king captured at ply p scores KING_CAPTURED_WHITE_WINS - p (faster wins score higher).
+// far above any material total in centipawns, promotions included
+static constexpr int KING_CAPTURED_WHITE_WINS = 100000;
+static constexpr int KING_CAPTURED_BLACK_WINS = -100000;
+// past this a score is a king capture, not material
+static constexpr int MATE_BOUND = KING_CAPTURED_WHITE_WINS - MAX_PLY - 1;
+
+// root move and what the last depth learned about it
+struct RootMove {
+  board::Move move;
+  int score = 0;  // side to move POV
+  bool searched = false;  // this depth
+  bool excluded = false;  // multipv: already in an earlier slot
+};
+
+// shared with the thread that wants the search to stop. polled every STOP_POLL_NODES nodes.
+// pondering = unbounded budget; main clears it on ponderhit, sets stop to abort
+struct SearchControl {
+  std::atomic<bool> stop{false};
+  std::atomic<bool> pondering{false};
+};
+
+// what to search for (go command). 0 = not set. node and time limits cover the whole move
+struct SearchLimits {
+  int max_nodes = 0;
+  int max_depth = 0;
+  int movetime_ms = 0;
+  int wtime_ms = 0, btime_ms = 0;  // remaining clock
+  int winc_ms = 0, binc_ms = 0;
+  bool infinite = false;
+  int multipv = 1;  // report the best K root moves
+  int contempt = 0;  // draws score this much below 0 for the side to move at the root
+  int record_plies = MAX_PLY;  // node tree kept under the root (gephi export), less while pondering
+  int info_interval_ms = 50;  // min gap between per-depth info reports, 0 = every depth
+};
+
+// search progress for info lines. score from white POV
+struct SearchInfo {
+  int depth = 0;
+  int seldepth = 0;
+  int score = 0;
+  int nodes = 0;
+  int nps = 0;
+  int time_ms = 0;
+  int hashfull = 0;  // per-mille of TT slots in use
+  int multipv = 0;  // 1-based slot in multipv mode, 0 otherwise
+  std::vector<board::Move> pv;
+};
+
+using InfoCallback = std::function<void(const SearchInfo&)>;
+
+// info after each depth, at most one per SearchLimits::info_interval_ms (last depth always),
+// plus one every INFO_PERIOD_MS while a depth takes long
+static constexpr int INFO_PERIOD_MS = 1000;
+
+// transposition table and the move ordering memory carried from search to search over a
+// game. one per concurrent game; iterative_deepen without one uses a process-wide instance
+static constexpr int TT_SIZE = 1 << 18;  // 256k entries
+struct SearchTables {
+  explicit SearchTables(int tt_size = TT_SIZE) : tt(static_cast<size_t>(tt_size)) {}
+  std::vector<TTEntry> tt;  // power of 2
+  std::array<std::array<std::optional<board::Move>, 2>, MAX_PLY> killers{};
+  moves::History history{};
+  // new game
+  void clear();
+};
+
+// power of 2. low enough that an abort lands well under 1ms
+static constexpr int STOP_POLL_NODES = 64;
+
+// ponder only keeps the first plies of the tree so unbounded search stays flat in memory
+static constexpr int PONDER_RECORD_PLIES = 2;
+
 struct SearchContext {
-  int nodes_used = 0;
-  int max_nodes = 3000;
+  int nodes_used = 0;  // whole move (ponder included), not per depth
+  int max_nodes = 0;  // 0 = unlimited
+  std::chrono::steady_clock::time_point start;
+  int hard_ms = 0;  // 0 = no time limit
+  SearchControl* control = nullptr;
+  bool stopped = false;  // sticky once control->stop seen or hard time up
+  bool pondering = false;
+  int seldepth = 0;
+  const InfoCallback* on_info = nullptr;  // not called while pondering
+  std::vector<SearchInfo> lines;  // last completed depth, one per multipv slot
+  int last_info_ms = -INFO_PERIOD_MS;
+  int record_plies = MAX_PLY;  // nodes at ply >= this drop their children
   std::vector<TTEntry>* tt = nullptr;
   int tt_mask = 0;  // size-1 for power-of-2
   std::array<std::array<std::optional<board::Move>, 2>, MAX_PLY> killers{};
-  bool budget_exceeded() const { return nodes_used >= max_nodes; }
+  moves::History* history = nullptr;
+  std::vector<RootMove>* root_moves = nullptr;  // root searches these in this order
+  bool excluding = false;  // multipv slot > 1: root result isnt stored in TT
+  // triangular pv: pv[ply] = best line from ply, pv_len[ply] long
+  std::array<std::array<board::Move, MAX_PLY + 1>, MAX_PLY + 1> pv{};
+  std::array<int, MAX_PLY + 1> pv_len{};
+  // previous depth's pv, searched first while follow_pv
+  std::array<board::Move, MAX_PLY + 1> prev_pv{};
+  int prev_pv_len = 0;
+  bool follow_pv = false;
+  // game history then the search path: keys of the positions above the current node
+  std::vector<uint64_t> keys;
+  int draw_score = 0;  // white POV, contempt applied
+  // once per node. only reads the shared atomics and clock every STOP_POLL_NODES
+  void poll();
+  int elapsed_ms() const;
+  void report_info();
+  bool budget_exceeded() const {
+    return stopped || (!pondering && max_nodes > 0 && nodes_used >= max_nodes);
+  }
 };
 
-// white max, black min. score from white POV
-int minimax(board::State& state, int depth, int alpha, int beta, SearchContext& ctx);
+// white max, black min. score from white POV. no node tree, pv in ctx.pv
+int minimax(board::State& state, int depth, int ply, int alpha, int beta, SearchContext& ctx);
 
-// minimax that builds node tree (populates children)
+// minimax that builds node tree (populates children) down to ctx.record_plies, minimax below
 int minimax_node(Node& node, int depth, int ply, int alpha, int beta, SearchContext& ctx);
 
-// depth 1, 2, ... until stop() or budget. stop checked at start of each depth
-void iterative_deepen(Node& root, int max_nodes = 3000, std::function<bool()> stop = nullptr);
+// depth 1, 2, ... until a limit or control->stop. on stop / hard time the root keeps
+// the result of the last completed depth. no limits apply while control->pondering
+void iterative_deepen(Node& root, const SearchLimits& limits, SearchControl* control = nullptr,
+    InfoCallback on_info = nullptr);
+void iterative_deepen(Node& root, const SearchLimits& limits, SearchTables& tables,
+    SearchControl* control = nullptr, InfoCallback on_info = nullptr);
 
 // child matching move (from/to), or nullptr
 Node* find_child(Node& root, const board::Move& move);
@@ -0,0 +1,276 @@
+#include "selfplay.hpp"
+#include "attacks.hpp"
+#include "dataset.hpp"
+#include "moves.hpp"
+#include "protocol.hpp"
+#include "search.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hexchess {
+namespace selfplay {
+
+namespace {
+
+// records per shard held before an append
+constexpr size_t FLUSH_RECORDS = 1 << 14;
+// per game. small: a game only sees a few thousand nodes per move
+constexpr int GAME_TT_SIZE = 1 << 16;
+constexpr int PROGRESS_MS = 10000;
+
+struct Options {
+  int games = 0;
+  std::string out;
+  std::string games_out;  // game records for the book builder (book.hpp), empty = none
+  int threads = 0;  // 0 = hardware
+  int shards = 0;  // 0 = one per thread
+  int nodes = 5000;
+  int depth = 0;
+  int variant = -1;  // -1 = all three in turn
+  int random_plies = 8;
+  int max_plies = 400;
+  unsigned seed = 1;
+};
+
+struct Game {
+  int shard = 0;
+  std::vector<dataset::Record> records;
+  std::string record;  // one line, empty without --games-out
+};
+
+// finished games queue up here; one thread appends them to the shard files, so games never
+// wait on the disk
+struct Writer {
+  std::string prefix;
+  std::ofstream games;
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Game> queue;
+  bool done = false;
+  bool failed = false;
+  std::vector<std::vector<dataset::Record>> buffers;
+};
+
+std::string shard_path(const std::string& prefix, int shard) {
+  char suffix[16];
+  std::snprintf(suffix, sizeof(suffix), "-%03d.bin", shard);
+  return prefix + suffix;
+}
+
+void writer_loop(Writer& w) {
+  auto flush = [&](int shard) {
+    std::vector<dataset::Record>& buf = w.buffers[static_cast<size_t>(shard)];
+    if (!buf.empty() && !dataset::append(shard_path(w.prefix, shard), buf)) w.failed = true;
+    buf.clear();
+  };
+  for (;;) {
+    std::unique_lock<std::mutex> lock(w.mutex);
+    w.cv.wait(lock, [&] { return w.done || !w.queue.empty(); });
+    if (w.queue.empty()) break;
+    Game item = std::move(w.queue.front());
+    w.queue.pop_front();
+    lock.unlock();
+    std::vector<dataset::Record>& buf = w.buffers[static_cast<size_t>(item.shard)];
+    buf.insert(buf.end(), item.records.begin(), item.records.end());
+    if (buf.size() >= FLUSH_RECORDS) flush(item.shard);
+    if (!item.record.empty() && !(w.games << item.record << '\n')) w.failed = true;
+  }
+  for (int s = 0; s < static_cast<int>(w.buffers.size()); ++s) flush(s);
+  if (w.games.is_open() && !w.games.flush()) w.failed = true;
+}
+
+struct Stats {
+  std::atomic<int> next_game{0};
+  std::atomic<int> games{0};
+  std::atomic<long long> positions{0};
+  std::atomic<int> white_wins{0}, draws{0}, black_wins{0};
+};
+
+std::vector<board::Move> legal_moves(board::State& state) {
+  std::vector<board::Move> legal;
+  bool white = state.white_to_play;
+  for (const board::Move& m : moves::generate(state)) {
+    board::State::UndoInfo ui = state.make_move(m);
+    if (!attacks::king_attacked(attacks::AttackMap(state), white)) legal.push_back(m);
+    state.undo_move(m, ui);
+  }
+  return legal;
+}
+
+void set_variant(board::State& state, int variant) {
+  if (variant == 1) state.set_mccooey();
+  else if (variant == 2) state.set_hexofen();
+  else state.set_glinski();
+}
+
+// plays games until the count is reached. one search table set per game (cleared between)
+void play_games(const Options& opt, int worker, int shards, Stats& stats, Writer& writer) {
+  std::mt19937_64 rng(opt.seed * 1000003ULL + static_cast<unsigned>(worker));
+  auto tables = std::make_unique<search::SearchTables>(GAME_TT_SIZE);
+  search::SearchLimits limits;
+  limits.max_nodes = opt.nodes;
+  limits.max_depth = opt.depth;
+  limits.record_plies = 0;
+  for (;;) {
+    int game = stats.next_game.fetch_add(1);
+    if (game >= opt.games) break;
+    tables->clear();
+    board::State state;
+    int variant = opt.variant >= 0 ? opt.variant : game % 3;
+    set_variant(state, variant);
+    std::vector<uint64_t> history;
+    Game out;
+    out.shard = game % shards;
+    std::vector<dataset::Record>& records = out.records;
+    // game record from the first searched position: random moves dont belong in a book
+    std::string start;
+    std::vector<board::Move> played;
+    int result = 0;
+    for (int ply = 0; ply < opt.max_plies; ++ply) {
+      // draws: fifty moves without pawn move or capture, threefold repetition
+      if (state.halfmove_clock >= 100 || std::count(history.begin(), history.end(), state.key) >= 2) break;
+      board::Move move;
+      if (ply < opt.random_plies) {
+        // randomized opening: no two games alike, not recorded
+        std::vector<board::Move> legal = legal_moves(state);
+        if (legal.empty()) break;
+        move = legal[rng() % legal.size()];
+      } else {
+        if (start.empty()) start = protocol::format_position(state);
+        search::Node root;
+        root.state = state;
+        root.history = history;
+        search::iterative_deepen(root, limits, *tables);
+        if (!root.best_move) break;
+        move = *root.best_move;
+        // quiet positions only: a capture on the board means the static eval cant match the score
+        bool quiet = !move.en_passant && !state.at(move.to_col, move.to_row);
+        if (quiet && std::abs(root.best_score) < search::MATE_BOUND)
+          if (auto r = dataset::pack(state, root.best_score, 0)) records.push_back(*r);
+      }
+      history.push_back(state.key);
+      if (!start.empty()) played.push_back(move);
+      board::State::UndoInfo ui = state.make_move(move);
+      if (ui.captured && ui.captured->type == 'K') {
+        result = state.white_to_play ? -1 : 1;
+        break;
+      }
+    }
+    for (dataset::Record& r : records) r.set_result(result);
+    (result > 0 ? stats.white_wins : result < 0 ? stats.black_wins : stats.draws)++;
+    stats.positions += static_cast<long long>(records.size());
+    stats.games++;
+    if (!opt.games_out.empty() && !start.empty()) {
+      out.record = start + " moves";
+      for (const board::Move& m : played) out.record += " " + protocol::format_move(m);
+      out.record += result > 0 ? " 1-0" : result < 0 ? " 0-1" : " 1/2-1/2";
+    }
+    {
+      std::lock_guard<std::mutex> lock(writer.mutex);
+      writer.queue.push_back(std::move(out));
+    }
+    writer.cv.notify_one();
+  }
+}
+
+void report(const Stats& stats, int games, int threads, double secs) {
+  int done = stats.games.load();
+  double per_core_hour = secs > 0 ? done * 3600.0 / secs / threads : 0.0;
+  std::printf("games %d/%d positions %lld +%d =%d -%d (%.0f games/hour/core)\n", done, games,
+      stats.positions.load(), stats.white_wins.load(), stats.draws.load(), stats.black_wins.load(), per_core_hour);
+  std::fflush(stdout);
+}
+
+int usage() {
+  std::fprintf(stderr,
+      "usage: engine selfplay --games N --out <prefix> [--threads N] [--shards N] [--nodes N] [--depth N]\n"
+      "  [--variant glinski|mccooey|hexofen|all] [--random-plies N] [--max-plies N] [--seed N] [--games-out <file>]\n");
+  return 2;
+}
+
+}  // namespace
+
+int run(int argc, char** argv) {
+  Options opt;
+  for (int i = 0; i + 1 < argc; i += 2) {
+    std::string arg = argv[i], val = argv[i + 1];
+    if (arg == "--games") opt.games = std::atoi(val.c_str());
+    else if (arg == "--out") opt.out = val;
+    else if (arg == "--games-out") opt.games_out = val;
+    else if (arg == "--threads") opt.threads = std::atoi(val.c_str());
+    else if (arg == "--shards") opt.shards = std::atoi(val.c_str());
+    else if (arg == "--nodes") opt.nodes = std::atoi(val.c_str());
+    else if (arg == "--depth") opt.depth = std::atoi(val.c_str());
+    else if (arg == "--random-plies") opt.random_plies = std::atoi(val.c_str());
+    else if (arg == "--max-plies") opt.max_plies = std::atoi(val.c_str());
+    else if (arg == "--seed") opt.seed = static_cast<unsigned>(std::atoi(val.c_str()));
+    else if (arg == "--variant") {
+      if (val == "glinski") opt.variant = 0;
+      else if (val == "mccooey") opt.variant = 1;
+      else if (val == "hexofen") opt.variant = 2;
+      else if (val == "all") opt.variant = -1;
+      else return usage();
+    } else {
+      return usage();
+    }
+  }
+  if (argc % 2 != 0 || opt.games <= 0 || opt.out.empty() || (opt.nodes <= 0 && opt.depth <= 0)) return usage();
+  int threads = opt.threads > 0 ? opt.threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  int shards = opt.shards > 0 ? opt.shards : threads;
+
+  Writer writer;
+  writer.prefix = opt.out;
+  writer.buffers.resize(static_cast<size_t>(shards));
+  if (!opt.games_out.empty()) {
+    writer.games.open(opt.games_out, std::ios::app);
+    if (!writer.games) {
+      std::fprintf(stderr, "could not write %s\n", opt.games_out.c_str());
+      return 1;
+    }
+  }
+  std::thread writer_thread(writer_loop, std::ref(writer));
+
+  Stats stats;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t)
+    workers.emplace_back(play_games, std::cref(opt), t, shards, std::ref(stats), std::ref(writer));
+  auto secs = [&] { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+  double last = 0.0;
+  while (stats.games.load() < opt.games) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if ((secs() - last) * 1000 >= PROGRESS_MS) {
+      last = secs();
+      report(stats, opt.games, threads, last);
+    }
+  }
+  for (auto& w : workers) w.join();
+  {
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    writer.done = true;
+  }
+  writer.cv.notify_one();
+  writer_thread.join();
+  report(stats, opt.games, threads, secs());
+  if (writer.failed) {
+    std::fprintf(stderr, "could not write %s-*.bin%s%s\n", opt.out.c_str(), opt.games_out.empty() ? "" : " or ",
+        opt.games_out.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace selfplay
+}  // namespace hexchess
@@ -0,0 +1,16 @@
+#pragma once
+
+namespace hexchess {
+namespace selfplay {
+
+// engine-vs-engine games for training data, many at once:
+// engine selfplay --games N --out <prefix> [--threads N] [--shards N] [--nodes N] [--depth N]
+//   [--variant glinski|mccooey|hexofen|all] [--random-plies N] [--max-plies N] [--seed N]
+//   [--games-out <file>]
+// positions go to <prefix>-000.bin ... as dataset records (dataset.hpp). --games-out also
+// appends every game as a line of text for the book builder (book.hpp).
+// args without "engine selfplay". returns the exit code
+int run(int argc, char** argv);
+
+}  // namespace selfplay
+}  // namespace hexchess
@@ -0,0 +1,245 @@
+#include "suite.hpp"
+#include "board.hpp"
+#include "eval.hpp"
+#include "moves.hpp"
+#include "protocol.hpp"
+#include "search.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hexchess {
+namespace suite {
+
+namespace {
+
+struct Entry {
+  std::string id;
+  board::State state;
+  std::vector<board::Move> best, avoid;
+};
+
+struct Result {
+  std::optional<board::Move> move;
+  bool solved = false;
+  // when the solution became the best move for good
+  int depth = 0, time_ms = 0;
+  long long nodes = 0;
+  // whole search
+  int total_ms = 0;
+  long long total_nodes = 0;
+};
+
+struct Options {
+  std::string file;
+  int nodes = 0;
+  int movetime_ms = 0;
+  int depth = 0;
+  int threads = 0;  // 0 = hardware
+};
+
+std::string trim(const std::string& s) {
+  size_t a = s.find_first_not_of(" \t\r");
+  if (a == std::string::npos) return "";
+  size_t b = s.find_last_not_of(" \t\r");
+  return s.substr(a, b - a + 1);
+}
+
+bool same_squares(const board::Move& a, const board::Move& b) {
+  return a.from_col == b.from_col && a.from_row == b.from_row && a.to_col == b.to_col && a.to_row == b.to_row;
+}
+
+// move list of a bm/am operation, each one the engine could play here
+bool parse_moves(const board::State& state, std::istringstream& iss, std::vector<board::Move>& out) {
+  std::vector<board::Move> generated = moves::generate(state);
+  for (std::string tok; iss >> tok;) {
+    auto parsed = protocol::parse_move(tok);
+    if (!parsed) return false;
+    auto it = std::find_if(generated.begin(), generated.end(), [&](const board::Move& m) { return same_squares(m, *parsed); });
+    if (it == generated.end()) return false;
+    out.push_back(*it);
+  }
+  return true;
+}
+
+// position, then operations split by ';'. unknown operations are skipped
+std::optional<Entry> parse_entry(const std::string& line) {
+  Entry e;
+  size_t used = protocol::parse_position(line, e.state);
+  if (used == 0) return std::nullopt;
+  std::istringstream ops(line.substr(used));
+  std::string op;
+  while (std::getline(ops, op, ';')) {
+    std::istringstream args(trim(op));
+    std::string code;
+    if (!(args >> code)) continue;
+    if (code == "bm" && !parse_moves(e.state, args, e.best)) return std::nullopt;
+    if (code == "am" && !parse_moves(e.state, args, e.avoid)) return std::nullopt;
+    if (code == "id") {
+      std::string id;
+      std::getline(args, id);
+      id = trim(id);
+      if (id.size() >= 2 && id.front() == '"' && id.back() == '"') id = id.substr(1, id.size() - 2);
+      e.id = id;
+    }
+  }
+  if (e.best.empty() && e.avoid.empty()) return std::nullopt;
+  return e;
+}
+
+bool solves(const Entry& e, const board::Move& m) {
+  auto listed = [&](const std::vector<board::Move>& v) {
+    return std::any_of(v.begin(), v.end(), [&](const board::Move& x) { return same_squares(x, m); });
+  };
+  return (e.best.empty() || listed(e.best)) && !listed(e.avoid);
+}
+
+// fresh tables per position so the order of the suite doesnt matter
+void solve(const Entry& e, const search::SearchLimits& limits, search::SearchTables& tables, Result& r) {
+  tables.clear();
+  search::Node root;
+  root.state = e.state;
+  bool found = false;
+  search::SearchInfo at, last;
+  search::InfoCallback on_info = [&](const search::SearchInfo& info) {
+    if (info.multipv > 1 || info.pv.empty()) return;
+    last = info;
+    if (!solves(e, info.pv.front())) found = false;
+    else if (!found) {
+      found = true;
+      at = info;
+    }
+  };
+  auto t0 = std::chrono::steady_clock::now();
+  search::iterative_deepen(root, limits, tables, nullptr, on_info);
+  r.total_ms = static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count());
+  r.total_nodes = last.nodes;
+  r.move = root.best_move;
+  r.solved = root.best_move && solves(e, *root.best_move);
+  if (!r.solved) return;
+  // a partial last depth can switch to the solution without a report
+  const search::SearchInfo& when = found ? at : last;
+  r.depth = when.depth;
+  r.time_ms = found ? at.time_ms : r.total_ms;
+  r.nodes = when.nodes;
+}
+
+double hit_rate(const eval::CacheStats& c) {
+  return c.probes > 0 ? 100.0 * static_cast<double>(c.hits) / static_cast<double>(c.probes) : 0.0;
+}
+
+int usage() {
+  std::fprintf(stderr, "usage: engine suite <file> [--nodes N | --movetime MS | --depth N] [--threads N]\n");
+  return 2;
+}
+
+}  // namespace
+
+int run(int argc, char** argv) {
+  if (argc < 1 || argc % 2 != 1) return usage();
+  Options opt;
+  opt.file = argv[0];
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i], val = argv[i + 1];
+    if (arg == "--nodes") opt.nodes = std::atoi(val.c_str());
+    else if (arg == "--movetime") opt.movetime_ms = std::atoi(val.c_str());
+    else if (arg == "--depth") opt.depth = std::atoi(val.c_str());
+    else if (arg == "--threads") opt.threads = std::atoi(val.c_str());
+    else return usage();
+  }
+  if ((opt.nodes > 0) + (opt.movetime_ms > 0) + (opt.depth > 0) > 1) return usage();
+  if (opt.nodes <= 0 && opt.depth <= 0) opt.movetime_ms = std::max(opt.movetime_ms, 1000);
+
+  std::ifstream in(opt.file);
+  if (!in) {
+    std::fprintf(stderr, "could not read %s\n", opt.file.c_str());
+    return 1;
+  }
+  std::vector<Entry> entries;
+  std::string line;
+  for (int n = 1; std::getline(in, line); ++n) {
+    line = trim(line);
+    if (line.empty() || line[0] == '#') continue;
+    auto e = parse_entry(line);
+    if (!e) {
+      std::fprintf(stderr, "%s:%d: invalid position\n", opt.file.c_str(), n);
+      continue;
+    }
+    if (e->id.empty()) e->id = "line " + std::to_string(n);
+    entries.push_back(std::move(*e));
+  }
+  if (entries.empty()) {
+    std::fprintf(stderr, "no positions\n");
+    return 1;
+  }
+
+  search::SearchLimits limits;
+  limits.max_nodes = opt.nodes;
+  limits.movetime_ms = opt.movetime_ms;
+  limits.max_depth = opt.depth;
+  limits.record_plies = 0;
+  limits.info_interval_ms = 0;
+  int threads = opt.threads > 0 ? opt.threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  threads = std::min(threads, static_cast<int>(entries.size()));
+
+  std::vector<Result> results(entries.size());
+  std::atomic<size_t> next{0};
+  auto start = std::chrono::steady_clock::now();
+  // cache counts are per thread, summed as each worker finishes
+  std::mutex cache_mutex;
+  eval::CacheStats eval_cache, pawn_cache;
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) {
+    pool.emplace_back([&] {
+      auto tables = std::make_unique<search::SearchTables>();
+      for (size_t i; (i = next.fetch_add(1)) < entries.size();) solve(entries[i], limits, *tables, results[i]);
+      std::lock_guard<std::mutex> lock(cache_mutex);
+      eval_cache.probes += eval::cache_stats().probes;
+      eval_cache.hits += eval::cache_stats().hits;
+      pawn_cache.probes += eval::pawn_cache_stats().probes;
+      pawn_cache.hits += eval::pawn_cache_stats().hits;
+    });
+  }
+  for (auto& th : pool) th.join();
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  int solved = 0;
+  long long solve_ms = 0, solve_nodes = 0, total_ms = 0, total_nodes = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const Result& r = results[i];
+    std::string move = r.move ? protocol::format_move(*r.move) : "(none)";
+    if (r.solved) {
+      std::printf("%-24s solved    depth %2d time %6d nodes %10lld move %s\n", entries[i].id.c_str(), r.depth,
+          r.time_ms, r.nodes, move.c_str());
+    } else {
+      std::printf("%-24s unsolved  move %s\n", entries[i].id.c_str(), move.c_str());
+    }
+    solved += r.solved;
+    // unsolved positions count their whole search
+    solve_ms += r.solved ? r.time_ms : r.total_ms;
+    solve_nodes += r.solved ? r.nodes : r.total_nodes;
+    total_ms += r.total_ms;
+    total_nodes += r.total_nodes;
+  }
+  std::printf("solved %d/%d, time to solve %lldms, nodes to solve %lld (unsolved count their whole search)\n",
+      solved, static_cast<int>(entries.size()), solve_ms, solve_nodes);
+  std::printf("searched %lldms %lld nodes, %.1fs on %d threads\n", total_ms, total_nodes, wall, threads);
+  std::printf("eval cache %.1f%% hits of %llu probes, pawn cache %.1f%% of %llu\n", hit_rate(eval_cache),
+      static_cast<unsigned long long>(eval_cache.probes), hit_rate(pawn_cache),
+      static_cast<unsigned long long>(pawn_cache.probes));
+  return 0;
+}
+
+}  // namespace suite
+}  // namespace hexchess
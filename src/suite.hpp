@@ -0,0 +1,14 @@
+#pragma once
+
+namespace hexchess {
+namespace suite {
+
+// tactical test suite, one position per line, EPD-like:
+//   <position> bm a3b4 [c1c2 ...]; [am d4d5;] id "name";
+// position as in protocol::parse_position, bm = best move(s), am = move(s) to avoid.
+// engine suite <file> [--nodes N | --movetime MS | --depth N] [--threads N]
+// every position gets its own search tables. args without "engine suite". returns the exit code
+int run(int argc, char** argv);
+
+}  // namespace suite
+}  // namespace hexchess
@@ -0,0 +1,917 @@
+#include "tablebase.hpp"
+#include "attacks.hpp"
+#include "eval.hpp"
+#include "moves.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "tablebase files are mapped as little-endian"
+#endif
+
+namespace hexchess {
+namespace tablebase {
+
+using board::Piece;
+using board::Variant;
+
+// every variant plays on the same 91 cells
+static constexpr int BOARD_CELLS = 91;
+static constexpr int MAX_PIECES = 5;
+// value byte: 0 draw, odd = the side to move takes the king in that many plies, even = loses its
+// own. longer lines than MAX_PLIES count as draws
+static constexpr int MAX_PLIES = 253;
+static constexpr uint8_t BROKEN = 0xFF;  // not a position: overlap, pawn on its last rank, symmetric copy
+static constexpr uint8_t NEVER = 0xFF;  // loss counter of a position that cant be lost
+static constexpr uint32_t TB_VERSION = 1;
+static constexpr uint8_t ANY_VARIANT = 0xFF;
+// file: 32 byte header, then block offsets, then the blocks. each block is BLOCK values as
+// (run, value) byte pairs, or raw when that is no smaller (RAW_BLOCK set in its offset)
+static constexpr size_t HEADER_BYTES = 32;
+static constexpr size_t NAME_BYTES = 15;
+static constexpr uint64_t BLOCK = 1024;
+static constexpr uint64_t RAW_BLOCK = 1ULL << 63;
+static const char PIECE_ORDER[] = "KQRBNP";
+static const char* const VARIANT_NAMES[3] = { "glinski", "mccooey", "hexofen" };
+
+// cell i counts column by column, like dataset records. the board's symmetries as cell
+// permutations: 0-5 rotations by 60 degrees, 6-11 the same after the left-right mirror, which
+// alone (6) keeps pawn moves. flip mirrors top and bottom, turning one colour's pawn moves into
+// the other's
+struct Geometry {
+  int to_attacks[BOARD_CELLS];
+  int from_attacks[attacks::CELLS];  // -1 off the board
+  int sym[12][BOARD_CELLS];
+  int flip[BOARD_CELLS];
+
+  Geometry() {
+    std::fill(from_attacks, from_attacks + attacks::CELLS, -1);
+    int n = 0;
+    for (int c = 0; c < board::NUM_COLS; ++c) {
+      for (int r = 0; r < board::max_row_glinski(c); ++r, ++n) {
+        to_attacks[n] = attacks::cell(c, r);
+        from_attacks[attacks::cell(c, r)] = n;
+      }
+    }
+    // cube coordinates around the centre cell: the six neighbours are the permutations of (1, -1, 0)
+    for (int i = 0; i < BOARD_CELLS; ++i) {
+      int col = attacks::cell_col(to_attacks[i]);
+      int x = col - 5, y = board::get_logical_row(col, attacks::cell_row(to_attacks[i])) - 5;
+      int a = x, b = -y, c = y - x;
+      for (int m = 0; m < 2; ++m) {
+        int p = m ? -a : a, q = m ? -c : b, s = m ? -b : c;
+        for (int k = 0; k < 6; ++k) {
+          sym[m * 6 + k][i] = cube_cell(p, q, s);
+          int np = -s, nq = -p, ns = -q;
+          p = np;
+          q = nq;
+          s = ns;
+        }
+      }
+      flip[i] = cube_cell(a, c, b);
+    }
+  }
+
+  int cube_cell(int a, int b, int c) const {
+    (void)c;
+    int col = a + 5, logical = 5 - b;
+    return from_attacks[attacks::cell(col, board::get_storage_row(col, logical))];
+  }
+};
+
+static const Geometry& geometry() {
+  static const Geometry g;
+  return g;
+}
+
+// where the white king may stand: the first cell of each orbit under the table's symmetries
+struct Symmetry {
+  std::vector<int> members;  // sym ids
+  int domain = 0;
+  int domain_index[BOARD_CELLS];  // -1 outside
+  int domain_cell[BOARD_CELLS];
+  std::vector<int> into[BOARD_CELLS];  // members taking the cell to its orbit's first cell
+
+  explicit Symmetry(std::vector<int> ids) : members(std::move(ids)) {
+    const Geometry& g = geometry();
+    for (int i = 0; i < BOARD_CELLS; ++i) {
+      int first = i;
+      for (int s : members) first = std::min(first, g.sym[s][i]);
+      for (int s : members)
+        if (g.sym[s][i] == first) into[i].push_back(s);
+      domain_index[i] = first == i ? domain : -1;
+      if (first == i) domain_cell[domain++] = i;
+    }
+  }
+};
+
+static const Symmetry& symmetry(bool pawns) {
+  static const Symmetry all({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 });
+  static const Symmetry mirror({ 0, 6 });
+  return pawns ? mirror : all;
+}
+
+static int piece_rank(char type) { return static_cast<int>(std::strchr(PIECE_ORDER, type) - PIECE_ORDER); }
+
+static std::string sorted_side(std::string side) {
+  std::sort(side.begin(), side.end(), [](char a, char b) { return piece_rank(a) < piece_rank(b); });
+  return side;
+}
+
+// a goes first (as white) over b: more pieces, else the stronger one at the first difference
+static bool stronger(const std::string& a, const std::string& b) {
+  if (a.size() != b.size()) return a.size() > b.size();
+  for (size_t i = 0; i < a.size(); ++i)
+    if (a[i] != b[i]) return piece_rank(a[i]) < piece_rank(b[i]);
+  return false;
+}
+
+// name of the set with white's and black's pieces. flipped: the colours swap in the table
+static std::string canonical(const std::string& white, const std::string& black, bool& flipped) {
+  std::string w = sorted_side(white), b = sorted_side(black);
+  flipped = stronger(b, w);
+  return flipped ? b + "v" + w : w + "v" + b;
+}
+
+// "KQvK" -> sides, each a king and its pieces, MAX_PIECES in all
+static bool split_name(const std::string& name, std::string& white, std::string& black) {
+  size_t v = name.find('v');
+  if (v == std::string::npos) return false;
+  white = name.substr(0, v);
+  black = name.substr(v + 1);
+  if (white.size() + black.size() > static_cast<size_t>(MAX_PIECES)) return false;
+  for (const std::string* side : { &white, &black }) {
+    if (std::count(side->begin(), side->end(), 'K') != 1) return false;
+    for (char c : *side)
+      if (!std::strchr(PIECE_ORDER, c)) return false;
+  }
+  return true;
+}
+
+static bool has_pawns(const std::string& name) { return name.find('P') != std::string::npos; }
+
+// positions of a set: white king in the symmetry domain, every other piece anywhere, side to move.
+// pieces: white king, white's pieces, black king, black's pieces, each side in PIECE_ORDER
+struct Layout {
+  std::string name;
+  int n = 0;
+  Piece pieces[MAX_PIECES];
+  bool pawns = false;
+  const Symmetry* sym = nullptr;
+  uint64_t size = 0;
+};
+
+static Layout make_layout(const std::string& name) {
+  Layout l;
+  l.name = name;
+  std::string white, black;
+  split_name(name, white, black);
+  for (char c : sorted_side(white)) l.pieces[l.n++] = Piece{ c, true };
+  for (char c : sorted_side(black)) l.pieces[l.n++] = Piece{ c, false };
+  l.pawns = has_pawns(name);
+  l.sym = &symmetry(l.pawns);
+  l.size = static_cast<uint64_t>(l.sym->domain) * 2;
+  for (int i = 1; i < l.n; ++i) l.size *= BOARD_CELLS;
+  return l;
+}
+
+// cells in layout order, any orientation. the least index over the symmetries that put the
+// white king in the domain, so a position and its mirror images share one index
+static uint64_t index_of(const Layout& l, const int* cells, bool white) {
+  const Geometry& g = geometry();
+  uint64_t best = UINT64_MAX;
+  for (int s : l.sym->into[cells[0]]) {
+    const int* perm = g.sym[s];
+    uint64_t index = static_cast<uint64_t>(l.sym->domain_index[perm[cells[0]]]);
+    for (int i = 1; i < l.n; ++i) index = index * BOARD_CELLS + static_cast<uint64_t>(perm[cells[i]]);
+    best = std::min(best, index * 2 + (white ? 0 : 1));
+  }
+  return best;
+}
+
+static void decode(const Layout& l, uint64_t index, int* cells, bool& white) {
+  white = (index & 1) == 0;
+  index >>= 1;
+  for (int i = l.n - 1; i >= 1; --i) {
+    cells[i] = static_cast<int>(index % BOARD_CELLS);
+    index /= BOARD_CELLS;
+  }
+  cells[0] = l.sym->domain_cell[index];
+}
+
+// pawn geometry of a variant, [white ? 0 : 1]
+struct Rules {
+  const attacks::Tables* t = nullptr;
+  bool start[2][BOARD_CELLS];
+  bool last[2][BOARD_CELLS];
+  int forward[2][BOARD_CELLS];  // one step ahead, -1 off the board
+  int back[2][BOARD_CELLS];
+};
+
+static const Rules& rules(Variant v) {
+  static const std::array<Rules, 3> all = [] {
+    std::array<Rules, 3> out;
+    const Geometry& g = geometry();
+    for (int k = 0; k < 3; ++k) {
+      Rules& r = out[static_cast<size_t>(k)];
+      board::State state;
+      state.variant = static_cast<Variant>(k);
+      r.t = &attacks::tables(state.variant);
+      for (int s = 0; s < 2; ++s) std::fill(r.back[s], r.back[s] + BOARD_CELLS, -1);
+      for (int i = 0; i < BOARD_CELLS; ++i) {
+        int col = attacks::cell_col(g.to_attacks[i]), row = attacks::cell_row(g.to_attacks[i]);
+        r.start[0][i] = moves::is_starting_pawn_white(state, col, row);
+        r.start[1][i] = moves::is_starting_pawn_black(state, col, row);
+        for (int s = 0; s < 2; ++s) {
+          r.last[s][i] = moves::is_promotion(state, col, row, s == 0);
+          int ahead = s == 0 ? row + 1 : row - 1;
+          r.forward[s][i] = state.on_board(col, ahead) ? g.from_attacks[attacks::cell(col, ahead)] : -1;
+        }
+      }
+      for (int s = 0; s < 2; ++s)
+        for (int i = 0; i < BOARD_CELLS; ++i)
+          if (r.forward[s][i] >= 0) r.back[s][r.forward[s][i]] = i;
+    }
+    return out;
+  }();
+  return all[static_cast<size_t>(v)];
+}
+
+struct Position {
+  int n = 0;
+  Piece piece[MAX_PIECES];
+  int cell[MAX_PIECES];
+  bool white = true;
+  int8_t at[BOARD_CELLS];  // piece index, -1 empty
+};
+
+static bool make_position(const Layout& l, const Rules& r, const int* cells, bool white, Position& p) {
+  p.n = l.n;
+  p.white = white;
+  std::fill(p.at, p.at + BOARD_CELLS, -1);
+  for (int i = 0; i < l.n; ++i) {
+    p.piece[i] = l.pieces[i];
+    p.cell[i] = cells[i];
+    if (p.at[cells[i]] >= 0) return false;
+    if (l.pieces[i].type == 'P' && r.last[l.pieces[i].white ? 0 : 1][cells[i]]) return false;
+    p.at[cells[i]] = static_cast<int8_t>(i);
+  }
+  return true;
+}
+
+// f(piece, to, captured piece or -1, promotion) for each move moves::generate makes here
+template <class F>
+static void for_each_move(const Rules& r, const Position& p, F&& f) {
+  const Geometry& g = geometry();
+  for (int i = 0; i < p.n; ++i) {
+    if (p.piece[i].white != p.white) continue;
+    int from = g.to_attacks[p.cell[i]];
+    auto target = [&](int to, bool promotion) {
+      int occ = p.at[to];
+      if (occ < 0) f(i, to, -1, promotion);
+      else if (p.piece[occ].white != p.white) f(i, to, occ, promotion);
+      return occ < 0;
+    };
+    auto list = [&](const int8_t* to) {
+      for (; *to >= 0; ++to) target(g.from_attacks[*to], false);
+    };
+    auto rays = [&](int first, int last) {
+      for (int d = first; d < last; ++d)
+        for (const int8_t* to = r.t->rays[from][d].data(); *to >= 0 && target(g.from_attacks[*to], false); ++to) {}
+    };
+    switch (p.piece[i].type) {
+      case 'K': list(r.t->king[from].data()); break;
+      case 'N': list(r.t->knight[from].data()); break;
+      case 'R': rays(0, attacks::FIRST_DIAG_RAY); break;
+      case 'B': rays(attacks::FIRST_DIAG_RAY, attacks::NUM_RAYS); break;
+      case 'Q': rays(0, attacks::NUM_RAYS); break;
+      case 'P': {
+        int s = p.white ? 0 : 1;
+        for (const int8_t* to = r.t->pawn_captures[s][from].data(); *to >= 0; ++to) {
+          int c = g.from_attacks[*to];
+          if (p.at[c] >= 0 && p.piece[p.at[c]].white != p.white) f(i, c, static_cast<int>(p.at[c]), r.last[s][c]);
+        }
+        int one = r.forward[s][p.cell[i]];
+        if (one < 0 || p.at[one] >= 0) break;
+        f(i, one, -1, r.last[s][one]);
+        int two = r.start[s][p.cell[i]] ? r.forward[s][one] : -1;
+        if (two >= 0 && p.at[two] < 0) f(i, two, -1, r.last[s][two]);
+        break;
+      }
+      default: break;
+    }
+  }
+}
+
+// f(piece, from) for each quiet move without promotion the side not to move could have just made
+template <class F>
+static void for_each_unmove(const Rules& r, const Position& p, F&& f) {
+  const Geometry& g = geometry();
+  for (int i = 0; i < p.n; ++i) {
+    if (p.piece[i].white == p.white) continue;
+    int at = g.to_attacks[p.cell[i]];
+    auto list = [&](const int8_t* from) {
+      for (; *from >= 0; ++from)
+        if (p.at[g.from_attacks[*from]] < 0) f(i, g.from_attacks[*from]);
+    };
+    auto rays = [&](int first, int last) {
+      for (int d = first; d < last; ++d)
+        for (const int8_t* from = r.t->rays[at][d].data(); *from >= 0 && p.at[g.from_attacks[*from]] < 0; ++from)
+          f(i, g.from_attacks[*from]);
+    };
+    switch (p.piece[i].type) {
+      case 'K': list(r.t->king[at].data()); break;
+      case 'N': list(r.t->knight[at].data()); break;
+      case 'R': rays(0, attacks::FIRST_DIAG_RAY); break;
+      case 'B': rays(attacks::FIRST_DIAG_RAY, attacks::NUM_RAYS); break;
+      case 'Q': rays(0, attacks::NUM_RAYS); break;
+      case 'P': {
+        int s = p.piece[i].white ? 0 : 1;
+        int one = r.back[s][p.cell[i]];
+        if (one < 0 || p.at[one] >= 0) break;
+        f(i, one);
+        int two = r.back[s][one];
+        if (two >= 0 && r.start[s][two] && p.at[two] < 0) f(i, two);
+        break;
+      }
+      default: break;
+    }
+  }
+}
+
+// a table file, mapped (or read on windows)
+struct Table {
+  Layout layout;
+  uint8_t variant = ANY_VARIANT;
+  const unsigned char* base = nullptr;
+  size_t bytes = 0;
+  const uint64_t* offsets = nullptr;
+  const unsigned char* data = nullptr;
+  std::vector<unsigned char> buffer;
+
+  Table() = default;
+  Table(const Table&) = delete;
+  Table& operator=(const Table&) = delete;
+  ~Table() {
+#ifndef _WIN32
+    if (buffer.empty() && base) munmap(const_cast<unsigned char*>(base), bytes);
+#endif
+  }
+
+  uint8_t value(uint64_t index) const {
+    uint64_t offset = offsets[index / BLOCK];
+    const unsigned char* p = data + (offset & ~RAW_BLOCK);
+    uint64_t k = index % BLOCK;
+    if (offset & RAW_BLOCK) return p[k];
+    for (; k >= p[0]; p += 2) k -= p[0];
+    return p[1];
+  }
+};
+
+// by file stem: the name, with the variant in front for sets with pawns
+static std::map<std::string, std::unique_ptr<Table>> g_tables;
+static int g_max_pieces = 0;
+static int g_max_phase = 0;
+
+static std::string table_key(uint8_t variant, const std::string& name) {
+  return variant == ANY_VARIANT ? name : std::string(VARIANT_NAMES[variant]) + "-" + name;
+}
+
+static std::unique_ptr<Table> map_table(const std::string& path) {
+  auto t = std::make_unique<Table>();
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(HEADER_BYTES)) {
+    close(fd);
+    return nullptr;
+  }
+  t->bytes = static_cast<size_t>(st.st_size);
+  void* base = mmap(nullptr, t->bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return nullptr;
+  t->base = static_cast<const unsigned char*>(base);
+#else
+  std::ifstream f(path, std::ios::binary);
+  if (!f) return nullptr;
+  t->buffer.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+  if (t->buffer.size() < HEADER_BYTES) return nullptr;
+  t->base = t->buffer.data();
+  t->bytes = t->buffer.size();
+#endif
+  const unsigned char* h = t->base;
+  uint32_t version;
+  uint64_t entries;
+  std::memcpy(&version, h + 4, 4);
+  std::memcpy(&entries, h + 24, 8);
+  std::string name(reinterpret_cast<const char*>(h + 9), strnlen(reinterpret_cast<const char*>(h + 9), NAME_BYTES));
+  std::string white, black;
+  bool flipped;
+  if (std::memcmp(h, "HXTB", 4) != 0 || version != TB_VERSION || !split_name(name, white, black) ||
+      canonical(white, black, flipped) != name || flipped)
+    return nullptr;
+  t->layout = make_layout(name);
+  t->variant = h[8];
+  if ((t->variant == ANY_VARIANT) == t->layout.pawns || (t->variant != ANY_VARIANT && t->variant > 2)) return nullptr;
+  uint64_t blocks = (t->layout.size + BLOCK - 1) / BLOCK;
+  if (entries != t->layout.size || t->bytes < HEADER_BYTES + (blocks + 1) * 8) return nullptr;
+  t->offsets = reinterpret_cast<const uint64_t*>(h + HEADER_BYTES);
+  t->data = h + HEADER_BYTES + (blocks + 1) * 8;
+  if (t->offsets[blocks] != t->bytes - static_cast<size_t>(t->data - h)) return nullptr;
+  return t;
+}
+
+static void add_table(std::unique_ptr<Table> t) {
+  int phase = 0;
+  for (int i = 0; i < t->layout.n; ++i) phase += eval::phase_weight(t->layout.pieces[i].type);
+  g_max_pieces = std::max(g_max_pieces, t->layout.n);
+  g_max_phase = std::max(g_max_phase, phase);
+  std::string key = table_key(t->variant, t->layout.name);
+  g_tables[key] = std::move(t);
+}
+
+// the loaded table's value for the pieces on cells, either colour may be the stronger side.
+// nullopt without a table
+static std::optional<uint8_t> lookup(Variant v, const Piece* pieces, const int* cells, int n, bool white) {
+  std::string w, b;
+  for (int i = 0; i < n; ++i) (pieces[i].white ? w : b) += pieces[i].type;
+  bool flipped;
+  std::string name = canonical(w, b, flipped);
+  auto it = g_tables.find(table_key(has_pawns(name) ? static_cast<uint8_t>(v) : ANY_VARIANT, name));
+  if (it == g_tables.end()) return std::nullopt;
+  const Table& t = *it->second;
+  // the pieces in the layout's order (colours swapped and board flipped if need be)
+  int ordered[MAX_PIECES];
+  bool used[MAX_PIECES] = {};
+  for (int k = 0; k < t.layout.n; ++k) {
+    const Piece& want = t.layout.pieces[k];
+    for (int i = 0; i < n; ++i) {
+      if (used[i] || pieces[i].type != want.type || (pieces[i].white != flipped) != want.white) continue;
+      used[i] = true;
+      ordered[k] = flipped ? geometry().flip[cells[i]] : cells[i];
+      break;
+    }
+  }
+  return t.value(index_of(t.layout, ordered, white != flipped));
+}
+
+int load(const std::string& dir) {
+  std::error_code ec;
+  int loaded = 0;
+  for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+    if (entry.path().extension() != ".hxtb") continue;
+    auto t = map_table(entry.path().string());
+    if (!t || table_key(t->variant, t->layout.name) != entry.path().stem().string()) return -1;
+    add_table(std::move(t));
+    ++loaded;
+  }
+  return ec ? -1 : loaded;
+}
+
+std::optional<int> probe(const board::State& state) {
+  // en passant needs pawns on both sides, which no table has
+  if (g_tables.empty() || state.phase > g_max_phase) return std::nullopt;
+  const Geometry& g = geometry();
+  Piece pieces[MAX_PIECES];
+  int cells[MAX_PIECES];
+  int n = 0;
+  for (int c = 0; c < board::NUM_COLS; ++c) {
+    const auto& column = state.cells[static_cast<size_t>(c)];
+    for (int r = 0; r < static_cast<int>(column.size()); ++r) {
+      if (!column[static_cast<size_t>(r)]) continue;
+      if (n == g_max_pieces) return std::nullopt;
+      pieces[n] = *column[static_cast<size_t>(r)];
+      cells[n++] = g.from_attacks[attacks::cell(c, r)];
+    }
+  }
+  auto v = lookup(state.variant, pieces, cells, n, state.white_to_play);
+  if (!v || *v == BROKEN) return std::nullopt;
+  return *v == 0 ? 0 : (*v % 2 ? *v : -*v);
+}
+
+std::optional<board::Move> best_move(const board::State& state, int& plies) {
+  if (!probe(state)) return std::nullopt;
+  board::State s = state;
+  std::optional<board::Move> best;
+  int best_rank = INT_MIN;
+  for (const board::Move& m : moves::generate(state)) {
+    board::State::UndoInfo ui = s.make_move(m);
+    bool takes_king = ui.captured && ui.captured->type == 'K';
+    std::optional<int> child = takes_king ? std::optional<int>(0) : probe(s);
+    s.undo_move(m, ui);
+    if (!child) return std::nullopt;
+    // the reply's plies are the opponent's, one more for this move
+    int mine = takes_king ? 1 : *child == 0 ? 0 : *child < 0 ? 1 - *child : -(*child + 1);
+    int rank = mine > 0 ? 1000 - mine : mine < 0 ? -1000 - mine : 0;
+    if (rank > best_rank) {
+      best_rank = rank;
+      best = m;
+      plies = mine;
+    }
+  }
+  return best;
+}
+
+namespace {
+
+struct Options {
+  std::string out;
+  Variant variant = Variant::Glinski;
+  int pieces = 0;
+  int threads = 0;  // 0 = hardware
+  std::vector<std::string> names;
+};
+
+template <class F>
+void parallel(int threads, uint64_t n, F f) {
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) {
+    uint64_t lo = n * static_cast<uint64_t>(t) / static_cast<uint64_t>(threads);
+    uint64_t hi = n * static_cast<uint64_t>(t + 1) / static_cast<uint64_t>(threads);
+    pool.emplace_back([=] { f(t, lo, hi); });
+  }
+  for (auto& th : pool) th.join();
+}
+
+struct Stats {
+  uint64_t wins = 0, losses = 0, draws = 0;
+  int longest = 0;
+  bool capped = false;
+};
+
+// retrograde: positions where the king can be taken are wins in 1. then pass by pass, the
+// positions decided last pass are unmoved: a loss in d-1 makes every predecessor a win in d, a
+// win in d-1 counts down each predecessor's undecided replies, and one without any left (and no
+// capture or promotion that keeps it alive) is a loss. captures and promotions lead into smaller,
+// already generated tables, whose results are fixed from the start
+std::vector<uint8_t> generate(const Layout& l, Variant v, int threads, Stats& stats, bool& missing) {
+  const Rules& r = rules(v);
+  uint64_t n = l.size;
+  std::unique_ptr<std::atomic<uint8_t>[]> val(new std::atomic<uint8_t>[n]());
+  std::unique_ptr<std::atomic<uint8_t>[]> left(new std::atomic<uint8_t>[n]());
+  std::vector<uint8_t> slowest(n, 0);  // longest win among the replies leaving the table
+  // positions decided at a given ply by the replies leaving the table
+  std::vector<std::vector<uint64_t>> due(MAX_PLIES + 2);
+  std::vector<std::vector<std::vector<uint64_t>>> parts(static_cast<size_t>(threads),
+      std::vector<std::vector<uint64_t>>(MAX_PLIES + 2));
+  std::atomic<bool> lost{false};
+
+  parallel(threads, n, [&](int t, uint64_t lo, uint64_t hi) {
+    auto& part = parts[static_cast<size_t>(t)];
+    int cells[MAX_PIECES];
+    bool white;
+    Position p;
+    std::vector<uint64_t> children;
+    for (uint64_t i = lo; i < hi; ++i) {
+      decode(l, i, cells, white);
+      if (!make_position(l, r, cells, white, p) || index_of(l, cells, white) != i) {
+        val[i].store(BROKEN, std::memory_order_relaxed);
+        left[i].store(NEVER, std::memory_order_relaxed);
+        continue;
+      }
+      bool take_king = false, can_draw = false, any = false;
+      int win_at = 0, most = 0;
+      children.clear();
+      for_each_move(r, p, [&](int piece, int to, int captured, bool promotion) {
+        any = true;
+        if (captured >= 0 && p.piece[captured].type == 'K') {
+          take_king = true;
+          return;
+        }
+        Piece pc[MAX_PIECES];
+        int cc[MAX_PIECES], m = 0;
+        for (int j = 0; j < p.n; ++j) {
+          if (j == captured) continue;
+          pc[m] = p.piece[j];
+          cc[m] = j == piece ? to : p.cell[j];
+          if (j == piece && promotion) pc[m].type = 'Q';
+          ++m;
+        }
+        if (captured < 0 && !promotion) {
+          children.push_back(index_of(l, cc, !white));
+          return;
+        }
+        auto e = lookup(v, pc, cc, m, !white);
+        if (!e || *e == BROKEN) {
+          lost = true;
+          return;
+        }
+        if (*e == 0) can_draw = true;
+        else if (*e % 2 == 0) win_at = win_at ? std::min(win_at, *e + 1) : *e + 1;
+        else most = std::max<int>(most, *e);
+      });
+      if (take_king) {
+        val[i].store(1, std::memory_order_relaxed);
+        left[i].store(NEVER, std::memory_order_relaxed);
+        part[1].push_back(i);
+        continue;
+      }
+      std::sort(children.begin(), children.end());
+      children.erase(std::unique(children.begin(), children.end()), children.end());
+      bool safe = win_at || can_draw || !any;
+      left[i].store(safe ? NEVER : static_cast<uint8_t>(children.size()), std::memory_order_relaxed);
+      slowest[i] = static_cast<uint8_t>(most);
+      if (win_at && win_at <= MAX_PLIES) part[static_cast<size_t>(win_at)].push_back(i);
+      else if (!safe && children.empty() && most + 1 <= MAX_PLIES) part[static_cast<size_t>(most + 1)].push_back(i);
+    }
+  });
+  missing = lost;
+  for (auto& part : parts)
+    for (size_t d = 0; d < part.size(); ++d) {
+      due[d].insert(due[d].end(), part[d].begin(), part[d].end());
+      std::vector<uint64_t>().swap(part[d]);
+    }
+
+  std::vector<uint64_t> current = std::move(due[1]), next;
+  std::vector<std::vector<uint64_t>> found(static_cast<size_t>(threads));
+  int d = 2;
+  for (; d <= MAX_PLIES; ++d) {
+    bool pending = false;
+    for (int k = d; k <= MAX_PLIES && !pending; ++k) pending = !due[static_cast<size_t>(k)].empty();
+    if (current.empty() && !pending) break;
+    bool win = d % 2 == 1;
+    parallel(threads, current.size(), [&](int t, uint64_t lo, uint64_t hi) {
+      auto& out = found[static_cast<size_t>(t)];
+      auto& later = parts[static_cast<size_t>(t)];
+      int cells[MAX_PIECES], before[MAX_PIECES];
+      bool white;
+      Position p;
+      std::vector<uint64_t> preds;
+      for (uint64_t k = lo; k < hi; ++k) {
+        decode(l, current[k], cells, white);
+        make_position(l, r, cells, white, p);
+        preds.clear();
+        for_each_unmove(r, p, [&](int piece, int from) {
+          std::copy(cells, cells + l.n, before);
+          before[piece] = from;
+          preds.push_back(index_of(l, before, !white));
+        });
+        std::sort(preds.begin(), preds.end());
+        preds.erase(std::unique(preds.begin(), preds.end()), preds.end());
+        for (uint64_t q : preds) {
+          uint8_t zero = 0;
+          if (win) {
+            if (val[q].compare_exchange_strong(zero, static_cast<uint8_t>(d))) out.push_back(q);
+            continue;
+          }
+          if (left[q].load(std::memory_order_relaxed) == NEVER || left[q].fetch_sub(1) != 1) continue;
+          int at = std::max(d, slowest[q] + 1);
+          if (at == d) {
+            if (val[q].compare_exchange_strong(zero, static_cast<uint8_t>(d))) out.push_back(q);
+          } else if (at <= MAX_PLIES) {
+            later[static_cast<size_t>(at)].push_back(q);
+          }
+        }
+      }
+    });
+    next.clear();
+    for (auto& out : found) {
+      next.insert(next.end(), out.begin(), out.end());
+      out.clear();
+    }
+    for (auto& part : parts)
+      for (size_t k = 0; k < part.size(); ++k) {
+        due[k].insert(due[k].end(), part[k].begin(), part[k].end());
+        part[k].clear();
+      }
+    for (uint64_t q : due[static_cast<size_t>(d)]) {
+      uint8_t zero = 0;
+      if (val[q].compare_exchange_strong(zero, static_cast<uint8_t>(d))) next.push_back(q);
+    }
+    std::vector<uint64_t>().swap(due[static_cast<size_t>(d)]);
+    current.swap(next);
+    if (!current.empty()) stats.longest = d;
+  }
+  stats.capped = d > MAX_PLIES && !current.empty();
+
+  std::vector<uint8_t> values(n);
+  for (uint64_t i = 0; i < n; ++i) {
+    uint8_t x = val[i].load(std::memory_order_relaxed);
+    values[i] = x;
+    if (x == BROKEN) continue;
+    if (x == 0) ++stats.draws;
+    else if (x % 2) ++stats.wins;
+    else ++stats.losses;
+  }
+  return values;
+}
+
+// broken entries repeat the value before them, which lengthens the runs
+bool write_table(const std::string& path, const Layout& l, uint8_t variant, const std::vector<uint8_t>& values) {
+  uint64_t blocks = (l.size + BLOCK - 1) / BLOCK;
+  std::vector<uint64_t> offsets;
+  std::string data;
+  uint8_t prev = 0;
+  std::vector<uint8_t> block;
+  for (uint64_t b = 0; b < blocks; ++b) {
+    block.clear();
+    for (uint64_t i = b * BLOCK; i < std::min(l.size, (b + 1) * BLOCK); ++i) {
+      if (values[i] != BROKEN) prev = values[i];
+      block.push_back(prev);
+    }
+    std::string rle;
+    for (size_t i = 0; i < block.size();) {
+      size_t j = i;
+      while (j < block.size() && block[j] == block[i] && j - i < 255) ++j;
+      rle.push_back(static_cast<char>(j - i));
+      rle.push_back(static_cast<char>(block[i]));
+      i = j;
+    }
+    if (rle.size() < block.size()) {
+      offsets.push_back(data.size());
+      data += rle;
+    } else {
+      offsets.push_back(data.size() | RAW_BLOCK);
+      data.append(reinterpret_cast<const char*>(block.data()), block.size());
+    }
+  }
+  offsets.push_back(data.size());
+  char header[HEADER_BYTES] = {};
+  std::memcpy(header, "HXTB", 4);
+  std::memcpy(header + 4, &TB_VERSION, 4);
+  header[8] = static_cast<char>(variant);
+  std::memcpy(header + 9, l.name.data(), std::min(l.name.size(), NAME_BYTES));
+  std::memcpy(header + 24, &l.size, 8);
+  std::ofstream f(path, std::ios::binary | std::ios::trunc);
+  f.write(header, HEADER_BYTES);
+  f.write(reinterpret_cast<const char*>(offsets.data()), static_cast<std::streamsize>(offsets.size() * 8));
+  f.write(data.data(), static_cast<std::streamsize>(data.size()));
+  return static_cast<bool>(f);
+}
+
+// the sets a position of name can turn into by one capture or promotion
+std::vector<std::string> successors(const std::string& name) {
+  std::string w, b;
+  split_name(name, w, b);
+  std::set<std::string> out;
+  bool flipped;
+  for (int side = 0; side < 2; ++side) {
+    std::string& mine = side ? b : w;
+    for (size_t i = 0; i < mine.size(); ++i) {
+      if (mine[i] == 'K') continue;
+      std::string keep = mine;
+      keep.erase(i, 1);
+      out.insert(side ? canonical(w, keep, flipped) : canonical(keep, b, flipped));
+      if (mine[i] != 'P') continue;
+      keep = mine;
+      keep[i] = 'Q';
+      out.insert(side ? canonical(w, keep, flipped) : canonical(keep, b, flipped));
+    }
+  }
+  return { out.begin(), out.end() };
+}
+
+// generates name after everything it turns into, skipping tables already there
+bool ensure(const std::string& name, const Options& opt, int threads) {
+  uint8_t variant = has_pawns(name) ? static_cast<uint8_t>(opt.variant) : ANY_VARIANT;
+  std::string key = table_key(variant, name);
+  if (g_tables.count(key)) return true;
+  for (const std::string& s : successors(name))
+    if (!ensure(s, opt, threads)) return false;
+
+  auto t0 = std::chrono::steady_clock::now();
+  Layout l = make_layout(name);
+  Stats stats;
+  bool missing = false;
+  std::vector<uint8_t> values = generate(l, opt.variant, threads, stats, missing);
+  std::string path = (std::filesystem::path(opt.out) / (key + ".hxtb")).string();
+  if (missing) {
+    std::fprintf(stderr, "%s: a smaller table is missing\n", name.c_str());
+    return false;
+  }
+  if (!write_table(path, l, variant, values)) {
+    std::fprintf(stderr, "could not write %s\n", path.c_str());
+    return false;
+  }
+  values = std::vector<uint8_t>();
+  auto t = map_table(path);
+  if (!t) {
+    std::fprintf(stderr, "could not map %s\n", path.c_str());
+    return false;
+  }
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  uint64_t total = stats.wins + stats.losses + stats.draws;
+  std::printf("%-12s positions %llu: %.1f%% won, %.1f%% lost, %.1f%% drawn for the side to move, longest %d plies%s, "
+      "%.1f MB in %.1fs\n", key.c_str(), static_cast<unsigned long long>(total),
+      100.0 * static_cast<double>(stats.wins) / static_cast<double>(std::max<uint64_t>(total, 1)),
+      100.0 * static_cast<double>(stats.losses) / static_cast<double>(std::max<uint64_t>(total, 1)),
+      100.0 * static_cast<double>(stats.draws) / static_cast<double>(std::max<uint64_t>(total, 1)), stats.longest,
+      stats.capped ? " (longer counted as draws)" : "", static_cast<double>(t->bytes) / 1e6, secs);
+  std::fflush(stdout);
+  add_table(std::move(t));
+  return true;
+}
+
+// every multiset of k pieces (no kings), in PIECE_ORDER
+void multisets(int k, size_t first, std::string& cur, std::vector<std::string>& out) {
+  if (k == 0) {
+    out.push_back(cur);
+    return;
+  }
+  for (size_t i = first; i + 1 < sizeof(PIECE_ORDER); ++i) {
+    cur.push_back(PIECE_ORDER[i]);
+    multisets(k - 1, i, cur, out);
+    cur.pop_back();
+  }
+}
+
+int usage() {
+  std::fprintf(stderr,
+      "usage: engine tablebase --out <dir> [--variant glinski|mccooey|hexofen] [--pieces N] [--threads N]\n"
+      "  [KQvK KRvKN ...]\n");
+  return 2;
+}
+
+}  // namespace
+
+int run(int argc, char** argv) {
+  Options opt;
+  for (int i = 0; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--", 0) != 0) {
+      opt.names.push_back(arg);
+      continue;
+    }
+    if (i + 1 >= argc) return usage();
+    std::string val = argv[++i];
+    if (arg == "--out") opt.out = val;
+    else if (arg == "--pieces") opt.pieces = std::atoi(val.c_str());
+    else if (arg == "--threads") opt.threads = std::atoi(val.c_str());
+    else if (arg == "--variant") {
+      if (val == "glinski") opt.variant = Variant::Glinski;
+      else if (val == "mccooey") opt.variant = Variant::McCooey;
+      else if (val == "hexofen") opt.variant = Variant::Hexofen;
+      else return usage();
+    } else {
+      return usage();
+    }
+  }
+  if (opt.out.empty() || opt.pieces < 0 || opt.pieces > MAX_PIECES) return usage();
+  if (opt.names.empty() && opt.pieces == 0) opt.pieces = 3;
+  int threads = opt.threads > 0 ? opt.threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+  std::vector<std::string> names;
+  bool flipped;
+  for (const std::string& name : opt.names) {
+    std::string w, b;
+    if (!split_name(name, w, b) || w[0] == 'P') {
+      std::fprintf(stderr, "%s: not a set like KQvK (at most %d pieces)\n", name.c_str(), MAX_PIECES);
+      return 2;
+    }
+    names.push_back(canonical(w, b, flipped));
+  }
+  for (int total = 2; total <= opt.pieces; ++total) {
+    for (int mine = 0; mine <= total - 2; ++mine) {
+      std::vector<std::string> white, black;
+      std::string cur;
+      multisets(mine, 1, cur, white);
+      multisets(total - 2 - mine, 1, cur, black);
+      for (const std::string& w : white)
+        for (const std::string& b : black) {
+          std::string name = canonical("K" + w, "K" + b, flipped);
+          if (std::find(names.begin(), names.end(), name) == names.end()) names.push_back(name);
+        }
+    }
+  }
+  // en passant rights are not part of a position here
+  names.erase(std::remove_if(names.begin(), names.end(), [](const std::string& name) {
+    std::string w, b;
+    split_name(name, w, b);
+    bool both = has_pawns(w) && has_pawns(b);
+    if (both) std::fprintf(stderr, "%s: pawns on both sides are not supported, skipped\n", name.c_str());
+    return both;
+  }), names.end());
+
+  std::error_code ec;
+  std::filesystem::create_directories(opt.out, ec);
+  if (load(opt.out) < 0) {
+    std::fprintf(stderr, "invalid table in %s\n", opt.out.c_str());
+    return 1;
+  }
+  for (const std::string& name : names)
+    if (!ensure(name, opt, threads)) return 1;
+  return 0;
+}
+
+}  // namespace tablebase
+}  // namespace hexchess
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "board.hpp"
+#include <optional>
+#include <string>
+
+namespace hexchess {
+namespace tablebase {
+
+// endgame tables, one file per material set, named like KQvK (white's pieces first). the colour
+// flipped set (KvKQ) is probed through the same file. every position of the set with either side
+// to move, scored as the search scores it: plies to the king capture with best play. pawnless
+// sets play the same on every variant's board and share one file (KQvK.hxtb), sets with pawns
+// are per variant (glinski-KPvK.hxtb). not covered: positions with en passant rights, sets where
+// both sides have pawns, the fifty move rule
+
+// maps every .hxtb file in dir. returns how many, -1 if one is malformed
+int load(const std::string& dir);
+// > 0: the side to move takes the king in that many plies, < 0: it loses its own in that many,
+// 0: draw. nullopt if no loaded table covers the position
+std::optional<int> probe(const board::State& state);
+// the move that keeps the table's result best (fastest win, slowest loss), with its plies as in
+// probe. nullopt if a reply leaves the loaded tables
+std::optional<board::Move> best_move(const board::State& state, int& plies);
+
+// engine tablebase --out <dir> [--variant glinski|mccooey|hexofen] [--pieces N] [--threads N]
+//   [KQvK KRvKN ...]
+// generates the named sets (or every set of up to --pieces pieces, 3 by default) and the
+// smaller ones they convert into. args without "engine tablebase". returns the exit code
+int run(int argc, char** argv);
+
+}  // namespace tablebase
+}  // namespace hexchess
@@ -0,0 +1,425 @@
+// cpu trainer for nnue nets (nnue.hpp). reads dataset files (dataset.hpp), fits the float
+// net with adam on minibatches split across threads, reports loss on held-out positions and
+// writes the net quantized in the engine's format.
+//
+// trainer --variant <glinski|mccooey|hexofen> --out <net> --data <file> [--data <file> ...]
+//   [--epochs N] [--batch N] [--lr X] [--threads N] [--val-fraction X] [--lambda X] [--seed N]
+
+#include "board.hpp"
+#include "dataset.hpp"
+#include "nnue.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace hexchess;
+
+namespace {
+
+constexpr int H = nnue::HIDDEN;
+constexpr int L2 = nnue::L2;
+constexpr int IN2 = 2 * H;
+// eval sigmoid: 1.0 of net output is OUTPUT_SCALE centipawns, win probability sigmoid(cp / 400)
+constexpr int OUTPUT_SCALE = 400;
+constexpr float SIGMOID_CP = 400.0f;
+// dense weights must fit int8 once scaled by QB
+constexpr float MAX_DENSE_WEIGHT = 127.0f / nnue::QB;
+
+struct Options {
+  std::vector<std::string> data;
+  std::string out;
+  board::Variant variant = board::Variant::Glinski;
+  int epochs = 10;
+  int batch = 4096;
+  float lr = 1e-3f;
+  int threads = 0;  // 0 = hardware
+  float val_fraction = 0.05f;
+  float lambda = 0.75f;  // weight of the search score against the game result
+  unsigned seed = 1;
+};
+
+// weights, gradient and adam moments of one tensor
+struct Tensor {
+  std::vector<float> w, g, m, v;
+  void init(size_t n, std::mt19937& rng, float lo, float hi) {
+    std::uniform_real_distribution<float> d(lo, hi);
+    w.resize(n);
+    for (float& x : w) x = d(rng);
+    g.assign(n, 0.0f);
+    m.assign(n, 0.0f);
+    v.assign(n, 0.0f);
+  }
+};
+
+struct Net {
+  Tensor ft_w, ft_b, l2_w, l2_b, out_w, out_b;
+};
+
+// one position as features. half 0 is the side to move
+struct Sample {
+  std::array<int, 2> n{};
+  std::array<std::array<int32_t, dataset::MAX_PIECES>, 2> f;
+  float target = 0.0f;
+};
+
+float sigmoid(float x) { return 1.0f / (1.0f + std::exp(-x)); }
+
+// false if a king is missing
+bool to_sample(const dataset::Record& r, float lambda, Sample& s) {
+  std::array<dataset::Placed, dataset::MAX_PIECES> placed;
+  int n = dataset::pieces(r, placed);
+  std::array<int, 2> king{ { -1, -1 } };
+  for (int i = 0; i < n; ++i) {
+    const dataset::Placed& p = placed[static_cast<size_t>(i)];
+    if (p.piece.type == 'K') king[p.piece.white ? 0 : 1] = nnue::oriented_cell(p.piece.white ? 0 : 1, p.col, p.storage_row);
+  }
+  if (king[0] < 0 || king[1] < 0) return false;
+  int stm = r.white_to_play() ? 0 : 1;
+  for (int half = 0; half < 2; ++half) {
+    int persp = half == 0 ? stm : 1 - stm;
+    s.n[static_cast<size_t>(half)] = 0;
+    for (int i = 0; i < n; ++i) {
+      const dataset::Placed& p = placed[static_cast<size_t>(i)];
+      int f = nnue::feature(persp, king[static_cast<size_t>(persp)], p.piece, p.col, p.storage_row);
+      if (f >= 0) s.f[static_cast<size_t>(half)][static_cast<size_t>(s.n[static_cast<size_t>(half)]++)] = f;
+    }
+  }
+  float score = static_cast<float>(r.white_to_play() ? r.score : -r.score);
+  float wdl = (static_cast<float>(r.white_to_play() ? r.result() : -r.result()) + 1.0f) / 2.0f;
+  s.target = lambda * sigmoid(score / SIGMOID_CP) + (1.0f - lambda) * wdl;
+  return true;
+}
+
+// activations of one forward pass
+struct Pass {
+  std::array<float, IN2> acc, x;
+  std::array<float, L2> pre, h;
+  float p = 0.0f;
+};
+
+void forward(const Net& net, const Sample& s, Pass& a) {
+  for (int half = 0; half < 2; ++half) {
+    float* acc = a.acc.data() + half * H;
+    std::copy(net.ft_b.w.begin(), net.ft_b.w.end(), acc);
+    for (int i = 0; i < s.n[static_cast<size_t>(half)]; ++i) {
+      const float* row = net.ft_w.w.data() + static_cast<size_t>(s.f[static_cast<size_t>(half)][static_cast<size_t>(i)]) * H;
+      for (int j = 0; j < H; ++j) acc[j] += row[j];
+    }
+  }
+  for (int j = 0; j < IN2; ++j) a.x[static_cast<size_t>(j)] = std::clamp(a.acc[static_cast<size_t>(j)], 0.0f, 1.0f);
+  float y = net.out_b.w[0];
+  for (int k = 0; k < L2; ++k) {
+    const float* row = net.l2_w.w.data() + k * IN2;
+    float sum = net.l2_b.w[static_cast<size_t>(k)];
+    for (int j = 0; j < IN2; ++j) sum += row[j] * a.x[static_cast<size_t>(j)];
+    a.pre[static_cast<size_t>(k)] = sum;
+    a.h[static_cast<size_t>(k)] = std::clamp(sum, 0.0f, 1.0f);
+    y += net.out_w.w[static_cast<size_t>(k)] * a.h[static_cast<size_t>(k)];
+  }
+  a.p = sigmoid(y * OUTPUT_SCALE / SIGMOID_CP);
+}
+
+// dense gradients of one thread
+struct Grads {
+  std::vector<float> l2_w, l2_b, out_w, ft_b;
+  float out_b = 0.0f;
+  double loss = 0.0;
+  void reset() {
+    l2_w.assign(static_cast<size_t>(L2) * IN2, 0.0f);
+    l2_b.assign(L2, 0.0f);
+    out_w.assign(L2, 0.0f);
+    ft_b.assign(H, 0.0f);
+    out_b = 0.0f;
+    loss = 0.0;
+  }
+};
+
+// loss and gradients for one sample. dacc: loss gradient wrt both accumulator halves
+void backward(const Net& net, const Sample& s, Grads& g, float* dacc) {
+  Pass a;
+  forward(net, s, a);
+  float err = a.p - s.target;
+  g.loss += static_cast<double>(err) * err;
+  float dy = 2.0f * err * a.p * (1.0f - a.p) * OUTPUT_SCALE / SIGMOID_CP;
+  g.out_b += dy;
+  std::array<float, IN2> dx{};
+  for (int k = 0; k < L2; ++k) {
+    g.out_w[static_cast<size_t>(k)] += dy * a.h[static_cast<size_t>(k)];
+    float pre = a.pre[static_cast<size_t>(k)];
+    if (pre <= 0.0f || pre >= 1.0f) continue;
+    float dh = dy * net.out_w.w[static_cast<size_t>(k)];
+    g.l2_b[static_cast<size_t>(k)] += dh;
+    float* grow = g.l2_w.data() + k * IN2;
+    const float* row = net.l2_w.w.data() + k * IN2;
+    for (int j = 0; j < IN2; ++j) {
+      grow[j] += dh * a.x[static_cast<size_t>(j)];
+      dx[static_cast<size_t>(j)] += dh * row[j];
+    }
+  }
+  for (int j = 0; j < IN2; ++j) {
+    float acc = a.acc[static_cast<size_t>(j)];
+    dacc[j] = acc > 0.0f && acc < 1.0f ? dx[static_cast<size_t>(j)] : 0.0f;
+    g.ft_b[static_cast<size_t>(j % H)] += dacc[j];
+  }
+}
+
+struct Adam {
+  float lr = 1e-3f, b1 = 0.9f, b2 = 0.999f, eps = 1e-8f;
+  int step = 0;
+  // one weight with gradient g (already averaged)
+  void update(float& w, float& m, float& v, float g, float c1, float c2) const {
+    m = b1 * m + (1.0f - b1) * g;
+    v = b2 * v + (1.0f - b2) * g * g;
+    w -= lr * (m / c1) / (std::sqrt(v / c2) + eps);
+  }
+  void update(Tensor& t, float clip) const {
+    float c1 = 1.0f - std::pow(b1, static_cast<float>(step));
+    float c2 = 1.0f - std::pow(b2, static_cast<float>(step));
+    for (size_t i = 0; i < t.w.size(); ++i) {
+      update(t.w[i], t.m[i], t.v[i], t.g[i], c1, c2);
+      if (clip > 0.0f) t.w[i] = std::clamp(t.w[i], -clip, clip);
+      t.g[i] = 0.0f;
+    }
+  }
+};
+
+// split [0, n) across threads
+template <typename F>
+void parallel(int threads, size_t n, F f) {
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) {
+    size_t lo = n * static_cast<size_t>(t) / static_cast<size_t>(threads);
+    size_t hi = n * static_cast<size_t>(t + 1) / static_cast<size_t>(threads);
+    pool.emplace_back([=] { f(t, lo, hi); });
+  }
+  for (auto& th : pool) th.join();
+}
+
+// one adam step on *records[batch[i]]. samples: scratch, one per batch entry
+double train_batch(Net& net, const std::vector<const dataset::Record*>& records, const std::vector<size_t>& batch,
+    float lambda, std::vector<Sample>& samples, std::vector<Grads>& grads, std::vector<float>& dacc,
+    std::vector<char>& touched, Adam& adam, int threads) {
+  parallel(threads, batch.size(), [&](int t, size_t lo, size_t hi) {
+    grads[static_cast<size_t>(t)].reset();
+    for (size_t i = lo; i < hi; ++i) {
+      to_sample(*records[batch[i]], lambda, samples[i]);
+      backward(net, samples[i], grads[static_cast<size_t>(t)], dacc.data() + i * IN2);
+    }
+  });
+  adam.step++;
+  float scale = 1.0f / static_cast<float>(batch.size());
+  double loss = 0.0;
+  for (const Grads& g : grads) {
+    for (size_t i = 0; i < g.l2_w.size(); ++i) net.l2_w.g[i] += g.l2_w[i] * scale;
+    for (int k = 0; k < L2; ++k) {
+      net.l2_b.g[static_cast<size_t>(k)] += g.l2_b[static_cast<size_t>(k)] * scale;
+      net.out_w.g[static_cast<size_t>(k)] += g.out_w[static_cast<size_t>(k)] * scale;
+    }
+    for (int j = 0; j < H; ++j) net.ft_b.g[static_cast<size_t>(j)] += g.ft_b[static_cast<size_t>(j)] * scale;
+    net.out_b.g[0] += g.out_b * scale;
+    loss += g.loss;
+  }
+  adam.update(net.l2_w, MAX_DENSE_WEIGHT);
+  adam.update(net.l2_b, 0.0f);
+  adam.update(net.out_w, MAX_DENSE_WEIGHT);
+  adam.update(net.out_b, 0.0f);
+  adam.update(net.ft_b, 0.0f);
+
+  // sparse first layer: thread t owns features f % threads == t, so rows never race.
+  // only rows seen in the batch are stepped (lazy adam)
+  float c1 = 1.0f - std::pow(adam.b1, static_cast<float>(adam.step));
+  float c2 = 1.0f - std::pow(adam.b2, static_cast<float>(adam.step));
+  parallel(threads, static_cast<size_t>(threads), [&](int t, size_t, size_t) {
+    std::vector<int32_t> rows;
+    for (size_t i = 0; i < batch.size(); ++i) {
+      const Sample& s = samples[i];
+      for (int half = 0; half < 2; ++half)
+        for (int k = 0; k < s.n[static_cast<size_t>(half)]; ++k) {
+          int32_t f = s.f[static_cast<size_t>(half)][static_cast<size_t>(k)];
+          if (f % threads != t) continue;
+          float* g = net.ft_w.g.data() + static_cast<size_t>(f) * H;
+          const float* d = dacc.data() + i * IN2 + half * H;
+          for (int j = 0; j < H; ++j) g[j] += d[j] * scale;
+          if (!touched[static_cast<size_t>(f)]) {
+            touched[static_cast<size_t>(f)] = 1;
+            rows.push_back(f);
+          }
+        }
+    }
+    for (int32_t f : rows) {
+      size_t base = static_cast<size_t>(f) * H;
+      for (size_t j = base; j < base + H; ++j) {
+        adam.update(net.ft_w.w[j], net.ft_w.m[j], net.ft_w.v[j], net.ft_w.g[j], c1, c2);
+        net.ft_w.g[j] = 0.0f;
+      }
+      touched[static_cast<size_t>(f)] = 0;
+    }
+  });
+  return loss;
+}
+
+// mean loss over records[first..]
+double validation_loss(const Net& net, const std::vector<const dataset::Record*>& records, size_t first,
+    float lambda, int threads) {
+  std::vector<double> sums(static_cast<size_t>(threads), 0.0);
+  parallel(threads, records.size() - first, [&](int t, size_t lo, size_t hi) {
+    Pass a;
+    Sample s;
+    for (size_t i = first + lo; i < first + hi; ++i) {
+      to_sample(*records[i], lambda, s);
+      forward(net, s, a);
+      float err = a.p - s.target;
+      sums[static_cast<size_t>(t)] += static_cast<double>(err) * err;
+    }
+  });
+  double sum = 0.0;
+  for (double x : sums) sum += x;
+  return records.size() > first ? sum / static_cast<double>(records.size() - first) : 0.0;
+}
+
+template <typename T>
+T quantize(float x, float scale) {
+  double q = std::round(static_cast<double>(x) * scale);
+  return static_cast<T>(std::clamp<double>(q, std::numeric_limits<T>::min(), std::numeric_limits<T>::max()));
+}
+
+nnue::Network quantize_net(const Net& net, board::Variant variant) {
+  nnue::Network q;
+  q.variant = static_cast<int>(variant);
+  q.output_scale = OUTPUT_SCALE;
+  const float qa = nnue::QA, qb = nnue::QB;
+  for (float w : net.ft_b.w) q.ft_bias.push_back(quantize<int16_t>(w, qa));
+  q.ft_weights.reserve(net.ft_w.w.size());
+  for (float w : net.ft_w.w) q.ft_weights.push_back(quantize<int16_t>(w, qa));
+  for (float w : net.l2_b.w) q.l2_bias.push_back(quantize<int32_t>(w, qa * qb));
+  for (float w : net.l2_w.w) q.l2_weights.push_back(quantize<int8_t>(w, qb));
+  q.out_bias = quantize<int32_t>(net.out_b.w[0], qa * qb);
+  for (float w : net.out_w.w) q.out_weights.push_back(quantize<int8_t>(w, qb));
+  return q;
+}
+
+// loss of the engine's own integer inference on held-out records
+double quantized_loss(const std::vector<const dataset::Record*>& records, size_t first, size_t limit, float lambda) {
+  double sum = 0.0;
+  size_t n = 0;
+  Sample s;
+  for (size_t i = first; i < records.size() && n < limit; ++i, ++n) {
+    to_sample(*records[i], lambda, s);
+    board::State state = dataset::unpack(*records[i]);
+    int cp = nnue::evaluate(state);
+    float p = sigmoid(static_cast<float>(state.white_to_play ? cp : -cp) / SIGMOID_CP);
+    float err = p - s.target;
+    sum += static_cast<double>(err) * err;
+  }
+  return n ? sum / static_cast<double>(n) : 0.0;
+}
+
+bool parse_variant(const std::string& name, board::Variant& v) {
+  if (name == "glinski") v = board::Variant::Glinski;
+  else if (name == "mccooey") v = board::Variant::McCooey;
+  else if (name == "hexofen") v = board::Variant::Hexofen;
+  else return false;
+  return true;
+}
+
+int usage() {
+  std::fprintf(stderr,
+      "usage: trainer --variant <glinski|mccooey|hexofen> --out <net> --data <file> [--data <file> ...]\n"
+      "  [--epochs N] [--batch N] [--lr X] [--threads N] [--val-fraction X] [--lambda X] [--seed N]\n");
+  return 2;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options opt;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i], val = argv[i + 1];
+    if (arg == "--data") opt.data.push_back(val);
+    else if (arg == "--out") opt.out = val;
+    else if (arg == "--variant") { if (!parse_variant(val, opt.variant)) return usage(); }
+    else if (arg == "--epochs") opt.epochs = std::atoi(val.c_str());
+    else if (arg == "--batch") opt.batch = std::max(1, std::atoi(val.c_str()));
+    else if (arg == "--lr") opt.lr = std::strtof(val.c_str(), nullptr);
+    else if (arg == "--threads") opt.threads = std::atoi(val.c_str());
+    else if (arg == "--val-fraction") opt.val_fraction = std::strtof(val.c_str(), nullptr);
+    else if (arg == "--lambda") opt.lambda = std::strtof(val.c_str(), nullptr);
+    else if (arg == "--seed") opt.seed = static_cast<unsigned>(std::atoi(val.c_str()));
+    else return usage();
+  }
+  if (argc % 2 == 0 || opt.data.empty() || opt.out.empty()) return usage();
+  int threads = opt.threads > 0 ? opt.threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+  // the files stay mapped for the whole run; records points into them, shuffled and split
+  std::vector<std::unique_ptr<dataset::Mapping>> files;
+  std::vector<const dataset::Record*> records;
+  Sample scratch;
+  for (const std::string& path : opt.data) {
+    files.push_back(std::make_unique<dataset::Mapping>());
+    if (!dataset::map(path, *files.back())) {
+      std::fprintf(stderr, "invalid dataset %s\n", path.c_str());
+      return 1;
+    }
+    for (const dataset::Record& r : *files.back())
+      if (r.variant() == opt.variant && to_sample(r, opt.lambda, scratch)) records.push_back(&r);
+  }
+  std::mt19937 rng(opt.seed);
+  std::shuffle(records.begin(), records.end(), rng);
+  if (records.size() < 2) {
+    std::fprintf(stderr, "not enough positions for this variant\n");
+    return 1;
+  }
+  size_t num_val = std::min(records.size() - 1, static_cast<size_t>(static_cast<double>(records.size()) * opt.val_fraction));
+  size_t num_train = records.size() - num_val;
+  std::printf("positions %zu train %zu validation %zu threads %d\n", records.size(), num_train, num_val, threads);
+
+  Net net;
+  net.ft_w.init(static_cast<size_t>(nnue::INPUTS) * H, rng, -0.05f, 0.05f);
+  net.ft_b.init(H, rng, 0.2f, 0.3f);
+  net.l2_w.init(static_cast<size_t>(L2) * IN2, rng, -0.1f, 0.1f);
+  net.l2_b.init(L2, rng, 0.0f, 0.1f);
+  net.out_w.init(L2, rng, -0.3f, 0.3f);
+  net.out_b.init(1, rng, 0.0f, 0.0f);
+
+  Adam adam;
+  adam.lr = opt.lr;
+  std::vector<Grads> grads(static_cast<size_t>(threads));
+  std::vector<Sample> samples(static_cast<size_t>(opt.batch));
+  std::vector<float> dacc(static_cast<size_t>(opt.batch) * IN2);
+  std::vector<char> touched(static_cast<size_t>(nnue::INPUTS), 0);
+  std::vector<size_t> order(num_train);
+  for (size_t i = 0; i < num_train; ++i) order[i] = i;
+
+  for (int epoch = 1; epoch <= opt.epochs; ++epoch) {
+    auto t0 = std::chrono::steady_clock::now();
+    std::shuffle(order.begin(), order.end(), rng);
+    double loss = 0.0;
+    for (size_t b = 0; b < num_train; b += static_cast<size_t>(opt.batch)) {
+      std::vector<size_t> batch(order.begin() + static_cast<std::ptrdiff_t>(b),
+          order.begin() + static_cast<std::ptrdiff_t>(std::min(num_train, b + static_cast<size_t>(opt.batch))));
+      loss += train_batch(net, records, batch, opt.lambda, samples, grads, dacc, touched, adam, threads);
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::printf("epoch %d train %.6f validation %.6f (%.0f pos/s)\n", epoch, loss / static_cast<double>(num_train),
+        validation_loss(net, records, num_train, opt.lambda, threads), static_cast<double>(num_train) / std::max(secs, 1e-9));
+    std::fflush(stdout);
+  }
+
+  if (!nnue::save_network(opt.out, quantize_net(net, opt.variant)) || !nnue::load_network(opt.out)) {
+    std::fprintf(stderr, "could not write %s\n", opt.out.c_str());
+    return 1;
+  }
+  if (num_val > 0)
+    std::printf("quantized validation %.6f\n", quantized_loss(records, num_train, 20000, opt.lambda));
+  std::printf("wrote %s\n", opt.out.c_str());
+  return 0;
+}
@@ -0,0 +1,242 @@
+#include "tune.hpp"
+#include "attacks.hpp"
+#include "dataset.hpp"
+#include "eval.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hexchess {
+namespace tune {
+
+namespace {
+
+// positions as sparse rows of eval::linear_terms, a few bytes per term, no per-position
+// allocations. row i is entries [begin[i], begin[i + 1])
+struct Positions {
+  std::vector<uint32_t> begin{ 0 };
+  std::vector<uint16_t> index;
+  std::vector<int16_t> coef;
+  std::vector<float> mg_weight;  // phase / MAX_PHASE
+  std::vector<int16_t> score;  // white POV
+  std::vector<int8_t> result;
+  size_t size() const { return mg_weight.size(); }
+
+  void append(const Positions& o) {
+    uint32_t base = begin.back();
+    for (size_t i = 1; i < o.begin.size(); ++i) begin.push_back(base + o.begin[i]);
+    index.insert(index.end(), o.index.begin(), o.index.end());
+    coef.insert(coef.end(), o.coef.begin(), o.coef.end());
+    mg_weight.insert(mg_weight.end(), o.mg_weight.begin(), o.mg_weight.end());
+    score.insert(score.end(), o.score.begin(), o.score.end());
+    result.insert(result.end(), o.result.begin(), o.result.end());
+  }
+};
+
+struct Options {
+  std::vector<std::string> data;
+  std::string out;
+  std::string params;
+  int iterations = 300;
+  double lr = 1.0;  // centipawns per step
+  int threads = 0;  // 0 = hardware
+  double lambda = 0.5;  // weight of the score against the game result
+};
+
+// split [0, n) across threads
+template <typename F>
+void parallel(int threads, size_t n, F f) {
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) {
+    size_t lo = n * static_cast<size_t>(t) / static_cast<size_t>(threads);
+    size_t hi = n * static_cast<size_t>(t + 1) / static_cast<size_t>(threads);
+    pool.emplace_back([=] { f(t, lo, hi); });
+  }
+  for (auto& th : pool) th.join();
+}
+
+// skips positions without both kings, where the eval means nothing
+Positions extract(const dataset::Record* records, size_t count, int threads) {
+  std::vector<Positions> parts(static_cast<size_t>(threads));
+  parallel(threads, count, [&](int t, size_t lo, size_t hi) {
+    Positions& out = parts[static_cast<size_t>(t)];
+    std::vector<eval::ParamCoef> terms;
+    board::State state;
+    for (size_t i = lo; i < hi; ++i) {
+      dataset::unpack(records[i], state);
+      attacks::AttackMap map(state);
+      if (map.side(true).king_cell < 0 || map.side(false).king_cell < 0) continue;
+      terms.clear();
+      eval::linear_terms(state, map, terms);
+      for (const eval::ParamCoef& c : terms) {
+        out.index.push_back(static_cast<uint16_t>(c.index));
+        out.coef.push_back(static_cast<int16_t>(c.coef));
+      }
+      out.begin.push_back(static_cast<uint32_t>(out.index.size()));
+      out.mg_weight.push_back(static_cast<float>(std::min(state.phase, eval::MAX_PHASE)) / eval::MAX_PHASE);
+      out.score.push_back(static_cast<int16_t>(records[i].score));
+      out.result.push_back(static_cast<int8_t>(records[i].result()));
+    }
+  });
+  Positions all;
+  for (const Positions& p : parts) all.append(p);
+  return all;
+}
+
+double sigmoid(double x) { return 1.0 / (1.0 + std::exp(-x)); }
+
+// mean squared error of sigmoid(k * eval) against the labels. with grads (one 2 * NUM_PARAMS
+// buffer per thread) also the gradient, summed into grads[0]. the loop allocates nothing
+double pass(const Positions& pos, const std::vector<double>& w, double k, double lambda, int threads,
+    std::vector<std::vector<double>>* grads) {
+  std::vector<double> errors(static_cast<size_t>(threads), 0.0);
+  parallel(threads, pos.size(), [&](int t, size_t lo, size_t hi) {
+    double* g = grads ? (*grads)[static_cast<size_t>(t)].data() : nullptr;
+    if (g) std::fill(g, g + 2 * eval::NUM_PARAMS, 0.0);
+    double err = 0.0;
+    for (size_t i = lo; i < hi; ++i) {
+      double rho = pos.mg_weight[i];
+      double e = 0.0;
+      for (uint32_t j = pos.begin[i]; j < pos.begin[i + 1]; ++j) {
+        size_t p = 2 * static_cast<size_t>(pos.index[j]);
+        e += pos.coef[j] * (w[p] * rho + w[p + 1] * (1.0 - rho));
+      }
+      double target = lambda * sigmoid(k * pos.score[i]) + (1.0 - lambda) * (pos.result[i] + 1) * 0.5;
+      double s = sigmoid(k * e);
+      err += (s - target) * (s - target);
+      if (!g) continue;
+      double d = 2.0 * (s - target) * s * (1.0 - s) * k;
+      for (uint32_t j = pos.begin[i]; j < pos.begin[i + 1]; ++j) {
+        size_t p = 2 * static_cast<size_t>(pos.index[j]);
+        g[p] += d * pos.coef[j] * rho;
+        g[p + 1] += d * pos.coef[j] * (1.0 - rho);
+      }
+    }
+    errors[static_cast<size_t>(t)] = err;
+  });
+  double err = 0.0;
+  for (double e : errors) err += e;
+  if (grads) {
+    std::vector<double>& sum = (*grads)[0];
+    for (size_t t = 1; t < grads->size(); ++t)
+      for (size_t p = 0; p < sum.size(); ++p) sum[p] += (*grads)[t][p];
+    for (double& x : sum) x /= static_cast<double>(pos.size());
+  }
+  return err / static_cast<double>(pos.size());
+}
+
+// scale of the eval sigmoid that fits the game results best with the starting params. not
+// fitted to the scores: those go through the same sigmoid, so any k would fit them
+double fit_k(const Positions& pos, const std::vector<double>& w, int threads) {
+  double lo = std::log(1e-3), hi = std::log(1e-1);
+  for (int i = 0; i < 30; ++i) {
+    double a = lo + (hi - lo) / 3, b = hi - (hi - lo) / 3;
+    if (pass(pos, w, std::exp(a), 0.0, threads, nullptr) < pass(pos, w, std::exp(b), 0.0, threads, nullptr))
+      hi = b;
+    else
+      lo = a;
+  }
+  return std::exp((lo + hi) / 2);
+}
+
+int usage() {
+  std::fprintf(stderr,
+      "usage: engine tune --data <file> [--data <file> ...] --out <params> [--params <start>]\n"
+      "  [--iterations N] [--lr X] [--threads N] [--lambda X]\n");
+  return 2;
+}
+
+}  // namespace
+
+int run(int argc, char** argv) {
+  Options opt;
+  for (int i = 0; i + 1 < argc; i += 2) {
+    std::string arg = argv[i], val = argv[i + 1];
+    if (arg == "--data") opt.data.push_back(val);
+    else if (arg == "--out") opt.out = val;
+    else if (arg == "--params") opt.params = val;
+    else if (arg == "--iterations") opt.iterations = std::atoi(val.c_str());
+    else if (arg == "--lr") opt.lr = std::atof(val.c_str());
+    else if (arg == "--threads") opt.threads = std::atoi(val.c_str());
+    else if (arg == "--lambda") opt.lambda = std::atof(val.c_str());
+    else return usage();
+  }
+  if (argc % 2 != 0 || opt.data.empty() || opt.out.empty()) return usage();
+  if (!opt.params.empty() && !eval::load_params(opt.params)) {
+    std::fprintf(stderr, "invalid params file %s\n", opt.params.c_str());
+    return 1;
+  }
+  int threads = opt.threads > 0 ? opt.threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+  auto t0 = std::chrono::steady_clock::now();
+  Positions pos;
+  // one file at a time, straight from the mapping
+  for (const std::string& path : opt.data) {
+    dataset::Mapping records;
+    if (!dataset::map(path, records)) {
+      std::fprintf(stderr, "invalid dataset %s\n", path.c_str());
+      return 1;
+    }
+    pos.append(extract(records.records, records.count, threads));
+  }
+  if (pos.size() == 0) {
+    std::fprintf(stderr, "no positions\n");
+    return 1;
+  }
+  double load_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  std::printf("positions %zu terms %zu (%.1f bytes/position) loaded in %.1fs\n", pos.size(), pos.index.size(),
+      static_cast<double>(pos.index.size() * 4 + pos.size() * 11) / static_cast<double>(pos.size()), load_s);
+
+  std::vector<eval::Score> start = eval::get_params();
+  std::vector<double> w(2 * eval::NUM_PARAMS);
+  for (int p = 0; p < eval::NUM_PARAMS; ++p) {
+    w[2 * static_cast<size_t>(p)] = start[static_cast<size_t>(p)].mg;
+    w[2 * static_cast<size_t>(p) + 1] = start[static_cast<size_t>(p)].eg;
+  }
+  double k = fit_k(pos, w, threads);
+  double initial = pass(pos, w, k, opt.lambda, threads, nullptr);
+  std::printf("k %.6f error %.6f\n", k, initial);
+
+  // adam, full batch
+  std::vector<std::vector<double>> grads(static_cast<size_t>(threads), std::vector<double>(w.size()));
+  std::vector<double> m(w.size(), 0.0), v(w.size(), 0.0);
+  const double b1 = 0.9, b2 = 0.999, eps = 1e-12;
+  auto t1 = std::chrono::steady_clock::now();
+  for (int it = 1; it <= opt.iterations; ++it) {
+    double error = pass(pos, w, k, opt.lambda, threads, &grads);
+    const std::vector<double>& g = grads[0];
+    double c1 = 1.0 - std::pow(b1, it), c2 = 1.0 - std::pow(b2, it);
+    for (size_t p = 0; p < w.size(); ++p) {
+      m[p] = b1 * m[p] + (1.0 - b1) * g[p];
+      v[p] = b2 * v[p] + (1.0 - b2) * g[p] * g[p];
+      w[p] -= opt.lr * (m[p] / c1) / (std::sqrt(v[p] / c2) + eps);
+    }
+    if (it % 25 == 0 || it == opt.iterations) {
+      double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+      std::printf("iteration %d error %.6f (%.0fms per pass)\n", it, error, 1000.0 * secs / it);
+      std::fflush(stdout);
+    }
+  }
+
+  std::vector<eval::Score> tuned(static_cast<size_t>(eval::NUM_PARAMS));
+  for (int p = 0; p < eval::NUM_PARAMS; ++p) {
+    tuned[static_cast<size_t>(p)].mg = static_cast<int>(std::lround(w[2 * static_cast<size_t>(p)]));
+    tuned[static_cast<size_t>(p)].eg = static_cast<int>(std::lround(w[2 * static_cast<size_t>(p) + 1]));
+  }
+  eval::set_params(tuned);
+  if (!eval::save_params(opt.out)) {
+    std::fprintf(stderr, "could not write %s\n", opt.out.c_str());
+    return 1;
+  }
+  std::printf("error %.6f -> %.6f, wrote %s\n", initial, pass(pos, w, k, opt.lambda, threads, nullptr), opt.out.c_str());
+  return 0;
+}
+
+}  // namespace tune
+}  // namespace hexchess
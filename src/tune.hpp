@@ -0,0 +1,13 @@
+#pragma once
+
+namespace hexchess {
+namespace tune {
+
+// texel tuning of the classical eval (eval::get_params) on dataset files:
+// engine tune --data <file> [--data <file> ...] --out <params> [--params <start>]
+//   [--iterations N] [--lr X] [--threads N] [--lambda X]
+// args without "engine tune". returns the exit code
+int run(int argc, char** argv);
+
+}  // namespace tune
+}  // namespace hexchess